@@ -30,19 +30,77 @@ DEALINGS IN THE SOFTWARE.
 // System and config header files are included by the parent stub file.
 #include <stdarg.h>
 #include <math.h>
+#include <limits.h>
 #include "printf.h"
 #include "printf_cfg.h"
 
+#if defined(PRINTF_MMAP) && !defined(BASIC_PRINTF_ONLY)
+    #include <string.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
 /* Define default macro to access the format string using a pointer. */
 #ifndef GET_FORMAT
     #define GET_FORMAT(p)   (*(p))
 #endif
 
+/* Format chars are read through a window of FORMAT_BLOCK bytes if they can be fetched in blocks. */
+#ifdef GET_FORMAT_BLOCK
+    #ifndef FORMAT_BLOCK
+        #define FORMAT_BLOCK    8
+    #endif
+    #define FORMAT_CHAR(p)  fmt_fetch(&window, p)
+#else
+    #define FORMAT_CHAR(p)  GET_FORMAT(p)
+#endif
+
+/* Define default macros to place and access constant lookup tables. */
+#ifndef FLASH_TABLE
+    #define FLASH_TABLE
+#endif
+#ifndef GET_TABLE_BYTE
+    #define GET_TABLE_BYTE(p)   (*(p))
+#endif
+#ifndef GET_TABLE_DWORD
+    #define GET_TABLE_DWORD(p)  (*(p))
+#endif
+#ifndef GET_TABLE_DOUBLE
+    #define GET_TABLE_DOUBLE(p) (*(p))
+#endif
+
+/* Define default timestamp for instrumentation. Without it only counts are kept. */
+#ifndef PRINTF_STATS_TIME
+    #define PRINTF_STATS_TIME()     0UL
+#endif
+
+/* Define default time stamp and barrier for sharded logging. */
+#ifndef PRINTF_SHARD_TIME
+    #define PRINTF_SHARD_TIME()     0UL
+#endif
+
+#ifndef PRINTF_SHARD_BARRIER
+  #ifdef __GNUC__
+    #define PRINTF_SHARD_BARRIER()  __sync_synchronize()
+  #else
+    #define PRINTF_SHARD_BARRIER()
+  #endif
+#endif
+
 /* Define default function for printf output. */
 #ifndef PUTCHAR_FUNC
     #define PUTCHAR_FUNC    putchar
 #endif
 
+/* The padding for printf is sent one char at a time unless there is a fill function. */
+#ifdef PUTFILL_FUNC
+    #define PUTFILL         fillout
+#else
+    #define PUTFILL         0
+#endif
+
 /* Renames the functions if they have been defined as macros in printf.h */
 #ifdef printf
     #undef  printf
@@ -58,6 +116,64 @@ DEALINGS IN THE SOFTWARE.
 // These are defined in print_cfg.h
 #define FEATURE(flag)   ((FEATURE_FLAGS) & (flag))
 
+// Count of steps with PRINTF_WCET: chars output and normalisation steps.
+#ifdef PRINTF_WCET
+    unsigned long printf_wcet_steps;
+    #define WCET_STEPS(n)   (printf_wcet_steps += (unsigned long) (n))
+#else
+    #define WCET_STEPS(n)   ((void) 0)
+#endif
+
+// Output of a single character, with or without the context.
+#ifdef BASIC_PRINTF_ONLY
+    #define OUT_PARAMS      void (*func)(char c)
+    #define OUT_ARGS        func
+    #define OUT(c)          (WCET_STEPS(1), func(c))
+#else
+    #define OUT_PARAMS      void *context, void (*func)(char c, void *context)
+    #define OUT_ARGS        context, func
+    #define OUT(c)          (WCET_STEPS(1), func(c, context))
+#endif
+
+// Arguments for a helper which only finds the length of its output.
+#ifdef BASIC_PRINTF_ONLY
+    #define OUT_ARGS_NULL   0
+#else
+    #define OUT_ARGS_NULL   context, 0
+#endif
+
+// Output with the fill function used for padding.
+#ifdef BASIC_PRINTF_ONLY
+    #define FILL_PARAMS     OUT_PARAMS
+    #define FILL_ARGS       OUT_ARGS
+#else
+    #define FILL_PARAMS     OUT_PARAMS, void (*fill)(char c, width_t n, void *context)
+    #define FILL_ARGS       OUT_ARGS, fill
+#endif
+
+#if FEATURE(USE_SPACE_PAD) || FEATURE(USE_EXACT_FLOAT)
+/* ---------------------------------------------------------------------------
+Function: fill_out()
+Output n copies of c for padding. The sink's fill function is used if it
+has one, so a wide field is not sent one char at a time.
+--------------------------------------------------------------------------- */
+static void fill_out(FILL_PARAMS, char c, int n)
+{
+    if (n <= 0) return;
+#ifndef BASIC_PRINTF_ONLY
+    if (fill)
+    {
+        WCET_STEPS(n);
+        fill(c, (width_t) n, context);
+        return;
+    }
+#endif
+    do
+        OUT(c);
+    while (--n);
+}
+#endif
+
 // Size of buffer for formatting numbers into.
 // Use the smallest buffer we can get away with to conserve RAM.
 #if FEATURE(USE_BINARY)
@@ -78,7 +194,35 @@ DEALINGS IN THE SOFTWARE.
     #endif
 #endif
 
+// Hex floating point needs space for a full double precision mantissa.
+#if FEATURE(USE_HEX_FLOAT) && BUFMAX < 30
+    #undef  BUFMAX
+    #define BUFMAX  30
+#endif
+
+// 128-bit octal needs 43 digits and the prefix. Binary is limited to 32 bits.
+#if FEATURE(USE_INT128)
+    #if !FEATURE(USE_LONG_LONG) || !defined(__SIZEOF_INT128__)
+        #error USE_INT128 needs USE_LONG_LONG and a compiler with __int128
+    #endif
+    #if BUFMAX < 44
+        #undef  BUFMAX
+        #define BUFMAX  44
+    #endif
+#endif
+
+// The output limit of each conversion must leave room for any number.
+#ifdef PRINTF_WCET
+    #ifndef PRINTF_WCET_CHARS
+        #define PRINTF_WCET_CHARS   64
+    #endif
+    #if PRINTF_WCET_CHARS < BUFMAX
+        #error PRINTF_WCET_CHARS must be at least BUFMAX
+    #endif
+#endif
+
 // Bit definitions in the flags variable (integer and general)
+// The public flags are passed to custom conversions and must match printf.h
 #if FEATURE(USE_LEFT_JUST)
   #define FL_LEFT_JUST  (1<<0)
 #else
@@ -99,11 +243,202 @@ DEALINGS IN THE SOFTWARE.
 #define FF_GCVT         (1<<3)
 #define FF_NRND         (1<<4)
 #define FF_XLONG        (1<<5)
+#define FF_X128         (1<<6)
 
 // Check whether integer or octal support is needed.
 #define HEX_CONVERT_ONLY    !(FEATURE(USE_SIGNED) || FEATURE(USE_SIGNED_I) || FEATURE(USE_UNSIGNED) || \
                               FEATURE(USE_OCTAL) || FEATURE(USE_BINARY))
 
+// Check whether any integer conversion is needed, hex included.
+#define INT_CONVERT         (!HEX_CONVERT_ONLY || FEATURE(USE_HEX_LOWER) || FEATURE(USE_HEX_UPPER))
+
+/*****************************************************************************
+Format character classification
+******************************************************************************/
+#if FEATURE(USE_FORMAT_TABLE)
+
+/* Each printable character in the format string has an entry in the class
+ * table, which tells the parser what the character means after a '%'.
+ * Conversions have CT_CONV set and a kind in bits 5-6. For integers the
+ * low bits give the base and sign, and for floating point the fflags.
+ * Other conversions have kind 0 and a unique value in the low bits.
+ * Entries without CT_CONV mark flag characters (with their flag bit), width
+ * and precision digits, and the length modifier. '0' is both a flag and a digit.
+ */
+#define CT_CONV         0x80
+#define CT_KIND         0xE0
+#define CT_FLT          0xA0
+#define CT_INT          0xC0
+#define CT_CHAR         0x80
+#define CT_STR          0x81
+#define CT_FSTR         0x82
+#define CT_TIME         0x83
+#define CT_HEXF         0x84
+#define CT_HEXF_U       0x85
+#define CT_JSON         0x86
+#define CT_CSV          0x87
+#define CT_SIGNED       0x01
+#define CT_BASE         0x1E
+#define CT_FFLAGS       0x0F
+#define CT_FLAG         0x40
+#define CT_FLAGS        0x1F
+#define CT_DIGIT        0x20
+#define CT_LENGTH       0x10
+
+#if FEATURE(USE_ZERO_PAD)
+  #define CT_0          (CT_FLAG | CT_DIGIT | FL_ZERO_PAD)
+#else
+  #define CT_0          CT_DIGIT
+#endif
+#if FEATURE(USE_PLUS_SIGN)
+  #define CT_PLUS       (CT_FLAG | FL_PLUS)
+#else
+  #define CT_PLUS       0
+#endif
+#if FEATURE(USE_LEFT_JUST)
+  #define CT_MINUS      (CT_FLAG | FL_LEFT_JUST)
+#else
+  #define CT_MINUS      0
+#endif
+#if FEATURE(USE_SPACE_SIGN)
+  #define CT_SPACE      (CT_FLAG | FL_SPACE)
+#else
+  #define CT_SPACE      0
+#endif
+#if FEATURE(USE_SPECIAL)
+  #define CT_HASH       (CT_FLAG | FL_SPECIAL)
+#else
+  #define CT_HASH       0
+#endif
+#if FEATURE(USE_LONG)
+  #define CT_l          CT_LENGTH
+#else
+  #define CT_l          0
+#endif
+#if FEATURE(USE_CHAR)
+  #define CT_c          CT_CHAR
+#else
+  #define CT_c          0
+#endif
+#if FEATURE(USE_SIGNED)
+  #define CT_d          (CT_INT | CT_SIGNED | 10)
+#else
+  #define CT_d          0
+#endif
+#if FEATURE(USE_SIGNED_I)
+  #define CT_i          (CT_INT | CT_SIGNED | 10)
+#else
+  #define CT_i          0
+#endif
+#if FEATURE(USE_UNSIGNED)
+  #define CT_u          (CT_INT | 10)
+#else
+  #define CT_u          0
+#endif
+#if FEATURE(USE_OCTAL)
+  #define CT_o          (CT_INT | 8)
+#else
+  #define CT_o          0
+#endif
+#if FEATURE(USE_BINARY)
+  #define CT_b          (CT_INT | 2)
+#else
+  #define CT_b          0
+#endif
+#if FEATURE(USE_HEX_LOWER)
+  #define CT_x          (CT_INT | 16)
+#else
+  #define CT_x          0
+#endif
+#if FEATURE(USE_HEX_UPPER)
+  #define CT_X          (CT_INT | 16)
+#else
+  #define CT_X          0
+#endif
+#if FEATURE(USE_FLOAT)
+  #define CT_f          (CT_FLT | FF_FCVT)
+  #define CT_e          (CT_FLT | FF_ECVT)
+  #define CT_E          (CT_FLT | FF_ECVT | FF_UCASE)
+  #define CT_g          (CT_FLT | FF_GCVT)
+  #define CT_G          (CT_FLT | FF_GCVT | FF_UCASE)
+#else
+  #define CT_f          0
+  #define CT_e          0
+  #define CT_E          0
+  #define CT_g          0
+  #define CT_G          0
+#endif
+#if FEATURE(USE_HEX_FLOAT)
+  #define CT_a          CT_HEXF
+  #define CT_A          CT_HEXF_U
+#else
+  #define CT_a          0
+  #define CT_A          0
+#endif
+#if FEATURE(USE_TIMESTAMP)
+  #define CT_T          CT_TIME
+#else
+  #define CT_T          0
+#endif
+#if FEATURE(USE_ESCAPE)
+  #define CT_J          CT_JSON
+  #define CT_Q          CT_CSV
+#else
+  #define CT_J          0
+  #define CT_Q          0
+#endif
+#if FEATURE(USE_STRING)
+  #define CT_s          CT_STR
+  #if FEATURE(USE_FSTRING)
+    #define CT_S        CT_FSTR
+  #else
+    #define CT_S        0
+  #endif
+#else
+  #define CT_s          0
+  #define CT_S          0
+#endif
+
+// Class table for characters ' ' to DEL.
+static const unsigned char fmt_table[96] FLASH_TABLE = {
+//  ' '       !     "     #        $     %     &     '     (     )     *     +        ,     -         .     /
+    CT_SPACE, 0,    0,    CT_HASH, 0,    0,    0,    0,    0,    0,    0,    CT_PLUS, 0,    CT_MINUS, 0,    0,
+//  0         1         2         3         4         5         6         7         8         9         :  ;  <  =  >  ?
+    CT_0,     CT_DIGIT, CT_DIGIT, CT_DIGIT, CT_DIGIT, CT_DIGIT, CT_DIGIT, CT_DIGIT, CT_DIGIT, CT_DIGIT, 0, 0, 0, 0, 0, 0,
+//  @     A     B     C     D     E     F     G     H     I     J     K     L     M     N     O
+    0,    CT_A, 0,    0,    0,    CT_E, 0,    CT_G, 0,    0,    CT_J, 0,    0,    0,    0,    0,
+//  P     Q     R     S     T     U     V     W     X     Y     Z     [     \     ]     ^     _
+    0,    CT_Q, 0,    CT_S, CT_T, 0,    0,    0,    CT_X, 0,    0,    0,    0,    0,    0,    0,
+//  `     a     b     c     d     e     f     g     h     i     j     k     l     m     n     o
+    0,    CT_a, CT_b, CT_c, CT_d, CT_e, CT_f, CT_g, 0,    CT_i, 0,    0,    CT_l, 0,    0,    CT_o,
+//  p     q     r     s     t     u     v     w     x     y     z     {     |     }     ~     DEL
+    0,    0,    0,    CT_s, 0,    CT_u, 0,    0,    CT_x, 0,    0,    0,    0,    0,    0,    0
+};
+
+// Look up the class of a format character. Anything outside the table has no class.
+#define FMT_CLASS(c)    ((unsigned char) ((c) - ' ') < sizeof(fmt_table) ? \
+                         GET_TABLE_BYTE(&fmt_table[(unsigned char) ((c) - ' ')]) : 0)
+
+// Fetch the next format character and its class.
+#define NEXT_FORMAT()   (convert = FORMAT_CHAR(++fmt), ctype = FMT_CLASS(convert))
+#define IS_DIGIT()      ((ctype & (CT_CONV | CT_DIGIT)) == CT_DIGIT)
+#define IS_LENGTH()     (ctype == CT_LENGTH)
+
+// Integer and floating point conversions each share a case, other conversions have their own.
+#define CT_CASE(t)      (((t) & (CT_KIND & ~CT_CONV)) ? ((t) & CT_KIND) : (t))
+#else
+#define NEXT_FORMAT()   (convert = FORMAT_CHAR(++fmt))
+#define IS_DIGIT()      (convert >= '0' && convert <= '9')
+#define IS_LENGTH()     (convert == 'l')
+#endif
+
+// Case label for a conversion, by its character or its class.
+#if FEATURE(USE_FORMAT_TABLE)
+    #define CONV_CASE(c, t) t
+#else
+    #define CONV_CASE(c, t) c
+#endif
+
 /*****************************************************************************
 Floating point 
 ******************************************************************************/
@@ -120,17 +455,41 @@ Floating point
   #define FLOAT_DIGITS  8
 #endif
 
-#if !FEATURE(USE_SMALL_FLOAT)
+#if FEATURE(USE_SMALL_FLOAT)
+    // No tables are needed for linear normalisation.
+#elif FEATURE(USE_FAST_NORM)
+    // Powers of ten for normalisation from an exponent estimate.
+    // 10^n is scale_lo[n % 32] * scale_hi[n / 32].
+    static const double scale_lo[32] FLASH_TABLE = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+        1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+        1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22, 1e23,
+        1e24, 1e25, 1e26, 1e27, 1e28, 1e29, 1e30, 1e31
+    };
+    static const double scale_hi[] FLASH_TABLE = {
+        1e0,  1e32,
+    #ifndef NO_DOUBLE_PRECISION
+        1e64, 1e96, 1e128, 1e160, 1e192, 1e224, 1e256, 1e288
+    #endif
+    };
+    #define SCALE_HI_LEN    (sizeof(scale_hi) / sizeof(scale_hi[0]))
+    // Largest power of ten which is used in one step, well within range.
+    #ifndef NO_DOUBLE_PRECISION
+        #define SCALE_LIMIT     300
+    #else
+        #define SCALE_LIMIT     30
+    #endif
+#else
     // Floating point normalisation tables for fast normalisation.
     // smalltable[] is used for value < 1.0
-    static const double smalltable[] = {
+    static const double smalltable[] FLASH_TABLE = {
     #ifndef NO_DOUBLE_PRECISION
         1e-256, 1e-128, 1e-64,
     #endif
         1e-32, 1e-16, 1e-8, 1e-4, 1e-2, 1e-1, 1.0
     };
     // large table[] is used for value >= 10.0
-    static const double largetable[] = {
+    static const double largetable[] FLASH_TABLE = {
     #ifndef NO_DOUBLE_PRECISION
         1e+256, 1e+128, 1e+64,
     #endif
@@ -166,6 +525,35 @@ static char *trim_zeros(char *p)
     return p;
 }
 
+#if FEATURE(USE_FAST_NORM) && !FEATURE(USE_SMALL_FLOAT)
+/* ---------------------------------------------------------------------------
+Function: scale10()
+Return number divided by 10^power10 using one operation from the tables.
+Denormals need a power which is out of range, so take two steps.
+--------------------------------------------------------------------------- */
+static double scale10(double number, flt_width_t power10)
+{
+    unsigned char neg = (power10 < 0);
+    double scale;
+
+    if (neg) power10 = -power10;
+    while (power10 > SCALE_LIMIT)
+    {
+        WCET_STEPS(1);
+        scale = GET_TABLE_DOUBLE(&scale_hi[SCALE_HI_LEN - 1]);
+        number = neg ? number * scale : number / scale;
+        power10 -= (SCALE_HI_LEN - 1) * 32;
+    }
+    if (power10)
+    {
+        WCET_STEPS(1);
+        scale = GET_TABLE_DOUBLE(&scale_lo[power10 & 31]) * GET_TABLE_DOUBLE(&scale_hi[power10 >> 5]);
+        number = neg ? number * scale : number / scale;
+    }
+    return number;
+}
+#endif
+
 /* ---------------------------------------------------------------------------
 Function: format_float()
 Called from the main doprnt function to handle formatting of floating point
@@ -247,14 +635,35 @@ static char *format_float(double number, flt_width_t ndigits, flt_width_t width,
          */
         // First make small numbers bigger.
         decpt = 1;
+    #ifdef PRINTF_WCET
+        // Large steps for very small or big numbers keep the number of
+        // operations bounded. Others take the same steps as before.
+        // 10^8 is exact in single precision as well.
+        while (number < 1e-16)
+        {
+            WCET_STEPS(1);
+            number *= 1e8;
+            decpt -= 8;
+        }
+    #endif
         while (number < 1.0)
         {
+            WCET_STEPS(1);
             number *= 10.0;
             --decpt;
         }
         // Then make big numbers smaller.
+    #ifdef PRINTF_WCET
+        while (number >= 1e16 && decpt <= DP_LIMIT)
+        {
+            WCET_STEPS(1);
+            number /= 1e8;
+            decpt += 8;
+        }
+    #endif
         while (number >= 10.0)
         {
+            WCET_STEPS(1);
             number /= 10.0;
             ++decpt;
 #ifdef NO_ISNAN_ISINF
@@ -269,6 +678,50 @@ static char *format_float(double number, flt_width_t ndigits, flt_width_t width,
             }
 #endif
         }
+#elif FEATURE(USE_FAST_NORM)
+        /* Estimate the decimal exponent from the binary exponent, which is
+         * larger by a factor of 1/log10(2), and scale by that power of ten
+         * in one operation. 1233/4096 is just below log10(2) so the estimate
+         * can only be one out, in which case the scaling is done again from
+         * the original number to avoid a second rounding error.
+         */
+        int bexp;
+        flt_width_t power10;
+        double scaled;
+
+        frexp(number, &bexp);
+        power10 = (flt_width_t) (((long) (bexp - 1) * 1233) / 4096);
+        scaled = scale10(number, power10);
+        if (scaled >= 10.0)
+            scaled = scale10(number, ++power10);
+        else if (scaled < 1.0)
+            scaled = scale10(number, --power10);
+        number = scaled;
+        decpt = 1 + power10;
+        // Correct any rounding across a power of ten.
+        while (number < 1.0)
+        {
+            WCET_STEPS(1);
+            number *= 10.0;
+            --decpt;
+        }
+        while (number >= 10.0)
+        {
+            WCET_STEPS(1);
+            number /= 10.0;
+            ++decpt;
+    #ifdef NO_ISNAN_ISINF
+            // Avoid this loop hanging on infinity.
+            if (decpt > DP_LIMIT)
+            {
+                buf[0] = 'I';
+                buf[1] = 'n';
+                buf[2] = 'f';
+                buf[3] = '\0';
+                return buf;
+            }
+    #endif
+        }
 #else
         /* Normalise using a binary search, making the largest possible
          * adjustment first and getting progressively smaller. This gets
@@ -281,9 +734,11 @@ static char *format_float(double number, flt_width_t ndigits, flt_width_t width,
         i = 0;
         while (number < 1.0)
         {
-            while (number < smalltable[i + 1])
+            WCET_STEPS(1);
+            while (number < GET_TABLE_DOUBLE(&smalltable[i + 1]))
             {
-                number /= smalltable[i];
+                WCET_STEPS(1);
+                number /= GET_TABLE_DOUBLE(&smalltable[i]);
                 decpt -= power10;
             }
             power10 >>= 1;
@@ -294,9 +749,11 @@ static char *format_float(double number, flt_width_t ndigits, flt_width_t width,
         i = 0;
         while (number >= 10.0)
         {
-            while (number >= largetable[i])
+            WCET_STEPS(1);
+            while (number >= GET_TABLE_DOUBLE(&largetable[i]))
             {
-                number /= largetable[i];
+                WCET_STEPS(1);
+                number /= GET_TABLE_DOUBLE(&largetable[i]);
                 decpt += power10;
 #ifdef NO_ISNAN_ISINF
                 // Avoid this loop hanging on infinity.
@@ -424,7 +881,7 @@ static char *format_float(double number, flt_width_t ndigits, flt_width_t width,
     {
         for (;;)
         {
-            if (i == 0)
+            if (p == buf + 2)
             {
                 // The rounding has rippled all the way through to
                 // the first digit. i.e. 9.999..9 -> 10.0
@@ -570,225 +1027,1662 @@ static char *format_float(double number, flt_width_t ndigits, flt_width_t width,
 
     return p;       // Start of string
 }
-#endif  // End of floating point section
-
+#if FEATURE(USE_EXACT_FLOAT)
 /*****************************************************************************
-Integer, character and string
+Exact fixed point conversion
 ******************************************************************************/
+#include <float.h>
+#include <stdint.h>
+
+/* The value is split into an integer part and a binary fraction, each held
+ * as a big integer in 32-bit limbs, least significant first. The integer
+ * part is converted by dividing by 10^9, giving 9 digits per division.
+ * The fraction is converted by multiplying by up to 10^9 and taking the
+ * bits above the binary point. This gives the exact decimal value for any
+ * precision with a fixed amount of working space.
+ */
+
+// Integer part of the largest value needs DBL_MAX_EXP bits.
+#define INT_LIMBS       ((DBL_MAX_EXP + 31) / 32)
+// Integer part in base 10^9, with space for a carry out of the top chunk.
+#define INT_CHUNKS      (DBL_MAX_10_EXP / 9 + 2)
+// Fraction of the smallest denormal needs 2 * DBL_MANT_DIG - DBL_MIN_EXP bits,
+// plus 30 bits above the binary point when multiplying by 10^9.
+#define FRAC_LIMBS      ((2 * DBL_MANT_DIG - DBL_MIN_EXP + 30 + 31) / 32)
+
+static const uint32_t pow10_table[10] FLASH_TABLE = {
+    1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL,
+    1000000UL, 10000000UL, 100000000UL, 1000000000UL
+};
 
-#if FEATURE(USE_SPACE_PAD)
 /* ---------------------------------------------------------------------------
-Function: p_len()
-Helper function to find length of string.
-This offers a small space saving over strlen and allows for reading strings
-from flash where the micro uses different semantics to access program memory.
-This is used on the AVR processor.
+Function: frac_digits()
+Multiply the binary fraction f, with s bits below the point, by 10^k.
+The integer part is removed from f and returned as the next k digits.
 --------------------------------------------------------------------------- */
-#if FEATURE(USE_FSTRING)
-static width_t p_len(char *p, unsigned char flags)
-#else
-static width_t p_len(char *p)
-#endif
+static uint32_t frac_digits(uint32_t *f, unsigned char n, unsigned s, unsigned char k)
 {
-    width_t len = 0;
-#if FEATURE(USE_FSTRING)
-    if (flags & FL_FSTR)
+    uint32_t mul = GET_TABLE_DWORD(&pow10_table[k]);
+    uint32_t carry = 0;
+    uint32_t digits;
+    unsigned char i;
+    unsigned char top = s / 32;
+    unsigned char shift = s % 32;
+
+    for (i = 0; i < n; i++)
     {
-        while (GET_FORMAT(p))
-        {
-            ++p;
-            ++len;
-        }
+        uint64_t t = (uint64_t) f[i] * mul + carry;
+        f[i] = (uint32_t) t;
+        carry = (uint32_t) (t >> 32);
     }
-    else
-#endif
+    digits = f[top] >> shift;
+    if (shift && top + 1 < n)
+        digits |= f[top + 1] << (32 - shift);
+    f[top] &= ((uint32_t) 1 << shift) - 1;
+    for (i = top + 1; i < n; i++)
+        f[i] = 0;
+    return digits;
+}
+
+// Return non-zero if any limb of the big integer is set.
+static uint32_t big_nonzero(const uint32_t *f, unsigned char n)
+{
+    uint32_t any = 0;
+    while (n) any |= f[--n];
+    return any;
+}
+
+/* ---------------------------------------------------------------------------
+Function: frac_round()
+Compare the remaining fraction against one half.
+Returns 1 if greater, 0 if equal and -1 if less.
+--------------------------------------------------------------------------- */
+static signed char frac_round(const uint32_t *f, unsigned s)
+{
+    uint32_t half;
+    unsigned char i;
+
+    if (s == 0)
+        return -1;
+    --s;
+    half = (uint32_t) 1 << (s % 32);
+    if (!(f[s / 32] & half))
+        return -1;
+    if (f[s / 32] & (half - 1))
+        return 1;
+    for (i = 0; i < s / 32; i++)
     {
-        while (*p++) ++len;
+        if (f[i])
+            return 1;
     }
-    return len;
+    return 0;
 }
-#endif
 
 /* ---------------------------------------------------------------------------
-Function: doprnt()
-This is the main worker function which does all the formatting.
-The output function must always be provided.
-Unless BASIC_PRINTF is defined it also needs the context variable,
-which tells the output function where to write.
+Function: exact_fixed()
+Called from the main doprnt function to output a finite value in 'f' format
+with exactly rounded digits for any precision, including padding.
+Output is written directly, so the length is not limited by the buffer.
+Rounding is to nearest with ties to even, as for the library printf.
+A first pass over the fraction finds where rounding stops rippling, so the
+second pass can write the digits in order as they are generated.
+Returns the number of characters written.
 --------------------------------------------------------------------------- */
-#ifdef BASIC_PRINTF_ONLY
-static printf_t doprnt(void (*func)(char c), const char *fmt, va_list ap)
-#else
-static printf_t doprnt(void *context, void (*func)(char c, void *context), const char *fmt, va_list ap)
-#endif
+static unsigned exact_fixed(FILL_PARAMS, double number, width_t ndigits, width_t width, unsigned char flags)
 {
-#if FEATURE(USE_LONG_LONG)
-    unsigned long long uvalue;
-#elif FEATURE(USE_LONG)
-    unsigned long uvalue;
-#else
-    unsigned uvalue;
-#endif
-#if !HEX_CONVERT_ONLY
-    unsigned base;
-#endif
-#if FEATURE(USE_SPACE_PAD) || FEATURE(USE_ZERO_PAD) || FEATURE(USE_FLOAT)
-    width_t width;
-    width_t fwidth;
-#endif
-#if FEATURE(USE_PRECISION) || FEATURE(USE_FLOAT)
-    width_t precision;
-#else
-    #define precision -1
-#endif
-    char convert, c;
-    char *p;
-    char buffer[BUFMAX+1];
-#ifdef PRINTF_T
-    printf_t count = 0;
-#endif
-    unsigned char flags;
-#if FEATURE(USE_FLOAT) || FEATURE(USE_LONG_LONG)
-    unsigned char fflags;
-#endif
-#if FEATURE(USE_FLOAT)
-    double fvalue;
-#endif
-
-    buffer[BUFMAX] = '\0';
+    uint32_t ipart[INT_LIMBS];
+    uint32_t ichunk[INT_CHUNKS];
+    uint32_t frac[FRAC_LIMBS];
+    uint32_t fcopy[FRAC_LIMBS];
+    uint32_t chunk;
+    uint64_t mant;
+    char digits[9];
+    int exp;
+    unsigned s = 0;
+    unsigned char nint;
+    unsigned char nfrac;
+    unsigned char nchunk = 0;
+    unsigned char i, k;
+    width_t pos;
+    width_t last = -1;
+    int len;
+    signed char cmp;
+    char c;
+    unsigned char round_up;
+    unsigned char odd;
+    int pad;
 
-    for (;;)
+    if (number < 0)
     {
-        convert = GET_FORMAT(fmt);
-        if (convert == 0) break;
-        if (convert == '%')
+        number = -number;
+        flags |= FL_NEG;
+    }
+    if (ndigits < 0)
+        ndigits = 0;
+
+    // Split the value into an integer mantissa and a power of 2.
+    mant = (uint64_t) ldexp(frexp(number, &exp), DBL_MANT_DIG);
+    exp -= DBL_MANT_DIG;
+
+    for (i = 0; i < INT_LIMBS; i++) ipart[i] = 0;
+    for (i = 0; i < FRAC_LIMBS; i++) frac[i] = 0;
+    if (exp >= 0)
+    {
+        // Whole number, shifted left into place.
+        k = exp % 32;
+        i = exp / 32;
+        ipart[i] = (uint32_t) (mant << k);
+        mant = k ? mant >> (32 - k) : mant >> 32;
+        while (mant && ++i < INT_LIMBS)
         {
-            p = buffer + BUFMAX;
-#if FEATURE(USE_PRECISION) || FEATURE(USE_FLOAT)
-            precision = -1;
+            ipart[i] = (uint32_t) mant;
+            mant >>= 32;
+        }
+    }
+    else
+    {
+        // The lowest s bits are the fraction.
+        s = -exp;
+        frac[0] = (uint32_t) mant;
+        frac[1] = (uint32_t) (mant >> 32);
+        if (s < 64)
+        {
+            mant >>= s;
+            ipart[0] = (uint32_t) mant;
+            ipart[1] = (uint32_t) (mant >> 32);
+            if (s >= 32)
+            {
+                frac[1] &= ((uint32_t) 1 << (s - 32)) - 1;
+            }
+            else
+            {
+                frac[0] &= ((uint32_t) 1 << s) - 1;
+                frac[1] = 0;
+            }
+        }
+    }
+    // Number of limbs needed to multiply the fraction by 10^9.
+    nfrac = (s + 30 + 31) / 32;
+
+    // Convert the integer part to base 10^9 by repeated division.
+    nint = INT_LIMBS;
+    while (nint && ipart[nint - 1] == 0) --nint;
+    do
+    {
+        uint32_t rem = 0;
+        for (i = nint; i; )
+        {
+            uint64_t t = ((uint64_t) rem << 32) | ipart[--i];
+            ipart[i] = (uint32_t) (t / 1000000000UL);
+            rem = (uint32_t) (t % 1000000000UL);
+        }
+        ichunk[nchunk++] = rem;
+        while (nint && ipart[nint - 1] == 0) --nint;
+    }
+    while (nint);
+
+    // First pass: find the last digit which is not a 9, and the rounding.
+    for (i = 0; i < nfrac; i++) fcopy[i] = frac[i];
+    odd = ichunk[0] & 1;
+    for (pos = 0; pos < ndigits && big_nonzero(fcopy, nfrac); pos += k)
+    {
+        k = (ndigits - pos > 9) ? 9 : ndigits - pos;
+        chunk = frac_digits(fcopy, nfrac, s, k);
+        odd = chunk & 1;
+        if (chunk != GET_TABLE_DWORD(&pow10_table[k]) - 1)
+        {
+            // Find the last non-9 digit in this chunk.
+            last = pos + k - 1;
+            while (chunk % 10 == 9)
+            {
+                chunk /= 10;
+                --last;
+            }
+        }
+    }
+    if (pos < ndigits)
+    {
+        // The fraction ran out. The remaining digits are 0 and there is no rounding.
+        last = ndigits - 1;
+        round_up = 0;
+    }
+    else
+    {
+        cmp = frac_round(fcopy, s);
+        round_up = (cmp > 0) || (cmp == 0 && odd);
+    }
+
+    // Rounding ripples into the integer part if all the digits are 9s.
+    if (round_up && last < 0)
+    {
+        for (i = 0; i < nchunk && ++ichunk[i] == 1000000000UL; i++)
+            ichunk[i] = 0;
+        if (i == nchunk)
+            ichunk[nchunk++] = 1;
+    }
+
+    // Work out the output length for padding.
+    len = (nchunk - 1) * 9 + 1;
+    for (chunk = ichunk[nchunk - 1]; chunk >= 10; chunk /= 10)
+        ++len;
+    if (ndigits || (flags & FL_SPECIAL))
+        len += ndigits + 1;
+    if (flags & (FL_NEG | FL_PLUS | FL_SPACE))
+        ++len;
+
+    // Leading spaces
+    pad = width - len;
+    if (pad < 0) pad = 0;
+    if (!(flags & (FL_LEFT_JUST | FL_ZERO_PAD)))
+        fill_out(FILL_ARGS, ' ', pad);
+    // Sign prefix
+    if      (flags & FL_NEG)    OUT('-');
+#if FEATURE(USE_PLUS_SIGN)
+    else if (flags & FL_PLUS)   OUT('+');
 #endif
-#if FEATURE(USE_SPACE_PAD) || FEATURE(USE_ZERO_PAD) || FEATURE(USE_FLOAT)
-            width = 0;
+#if FEATURE(USE_SPACE_SIGN)
+    else if (flags & FL_SPACE)  OUT(' ');
 #endif
-#if FEATURE(USE_FLOAT) || FEATURE(USE_LONG_LONG)
-            fflags = 0;
+    // Leading zeros
+    if ((flags & (FL_LEFT_JUST | FL_ZERO_PAD)) == FL_ZERO_PAD)
+        fill_out(FILL_ARGS, '0', pad);
+
+    // Integer part, 9 digits per chunk except the first.
+    k = 0;
+    while (nchunk)
+    {
+        chunk = ichunk[--nchunk];
+        i = 9;
+        do
+        {
+            digits[--i] = chunk % 10 + '0';
+            chunk /= 10;
+        }
+        while (i && (chunk || k));
+        k = 1;
+        for (; i < 9; i++)
+            OUT(digits[i]);
+    }
+
+    // Second pass: generate the fraction digits again and output them.
+    if (ndigits || (flags & FL_SPECIAL))
+        OUT('.');
+    for (pos = 0; pos < ndigits; pos += k)
+    {
+        k = (ndigits - pos > 9) ? 9 : ndigits - pos;
+        chunk = frac_digits(frac, nfrac, s, k);
+        for (i = k; i; )
+        {
+            digits[--i] = chunk % 10 + '0';
+            chunk /= 10;
+        }
+        for (; i < k; i++)
+        {
+            c = digits[i];
+            if (round_up && pos + i >= last)
+                c = (pos + i == last) ? c + 1 : '0';
+            OUT(c);
+        }
+    }
+
+    // Trailing spaces
+    if (flags & FL_LEFT_JUST)
+        fill_out(FILL_ARGS, ' ', pad);
+
+    return (unsigned) (len + pad);
+}
+#endif  // USE_EXACT_FLOAT
+#endif  // End of floating point section
+
+/*****************************************************************************
+Hexadecimal floating point
+******************************************************************************/
+#if FEATURE(USE_HEX_FLOAT)
+#include <stdint.h>
+
+// Layout of the IEEE-754 value held in a double.
+#ifdef NO_DOUBLE_PRECISION
+    typedef uint32_t fbits_t;
+    #define FRAC_BITS   23
+    #define EXP_BITS    8
+#else
+    typedef uint64_t fbits_t;
+    #define FRAC_BITS   52
+    #define EXP_BITS    11
 #endif
-            flags = 0;
+#define EXP_BIAS        ((1 << (EXP_BITS - 1)) - 1)
+#define EXP_MAX         ((1 << EXP_BITS) - 1)
+// The fraction is shown as whole hex digits.
+#define HEX_DIGITS      ((FRAC_BITS + 3) / 4)
+// Space for sign, 0x, leading digit, point, p, exponent sign and 4 exponent digits.
+#define DIGITS_MAX_A    (BUFMAX - 11)
 
-            // Extract flag chars
-            for (;;)
+/* ---------------------------------------------------------------------------
+Function: format_hex_float()
+Called from the main doprnt function to handle %a and %A formatting.
+The mantissa and exponent are taken directly from the bits of the value,
+so no floating point arithmetic is needed. The output is exact unless
+the precision asks for fewer digits, when it is rounded to nearest even.
+The string is built backwards from the end of the buffer.
+--------------------------------------------------------------------------- */
+static char *format_hex_float(double number, width_t ndigits, width_t width,
+                              unsigned char flags, unsigned char fflags, char *buf)
+{
+    union
+    {
+        double d;
+        fbits_t u;
+    } v;
+    fbits_t mant;
+    fbits_t half;
+    fbits_t rem;
+    int exp;
+    char lead;
+    char hexa = (fflags & FF_UCASE) ? 'A' - 10 : 'a' - 10;
+    char *p = buf + BUFMAX;
+    char c;
+
+    v.d = number;
+    exp = (int) (v.u >> FRAC_BITS) & EXP_MAX;
+    // Left-align the fraction to a whole number of hex digits.
+    mant = (v.u & (((fbits_t) 1 << FRAC_BITS) - 1)) << (HEX_DIGITS * 4 - FRAC_BITS);
+    if (exp == EXP_MAX)
+    {
+        // Handle special values which need no formatting
+        buf[0] = mant ? 'N' : 'I';
+        buf[1] = mant ? 'a' : 'n';
+        buf[2] = mant ? 'N' : 'f';
+        buf[3] = '\0';
+        return buf;
+    }
+    if (v.u >> (FRAC_BITS + EXP_BITS))
+        flags |= FL_NEG;
+    if (exp == 0)
+    {
+        // Zero or denormal
+        lead = 0;
+        exp = mant ? 1 - EXP_BIAS : 0;
+    }
+    else
+    {
+        lead = 1;
+        exp -= EXP_BIAS;
+    }
+
+    if (ndigits < 0)
+    {
+        // Default precision shows the exact value without trailing zeros.
+        ndigits = HEX_DIGITS;
+        while (ndigits && !(mant & 0x0f))
+        {
+            mant >>= 4;
+            --ndigits;
+        }
+    }
+    else if (ndigits < HEX_DIGITS)
+    {
+        // Round off the unwanted digits. A carry may reach the leading digit.
+        half = (fbits_t) 1 << ((HEX_DIGITS - ndigits) * 4 - 1);
+        rem = mant & ((half << 1) - 1);
+        mant >>= (HEX_DIGITS - ndigits) * 4;
+        if (rem > half || (rem == half && ((ndigits ? mant : (fbits_t) lead) & 1)))
+        {
+            if (++mant >> (ndigits * 4))
             {
-                convert = GET_FORMAT(++fmt);
+                mant = 0;
+                ++lead;
+            }
+        }
+    }
+    else if (ndigits > DIGITS_MAX_A)
+    {
+        ndigits = DIGITS_MAX_A;
+    }
+
+    // Exponent is always printed in decimal with at least one digit.
+    c = '+';
+    if (exp < 0)
+    {
+        exp = -exp;
+        c = '-';
+    }
+    do *--p = exp % 10 + '0';
+    while ((exp /= 10) != 0);
+    *--p = c;
+    *--p = (fflags & FF_UCASE) ? 'P' : 'p';
+
+    // Fraction digits, with trailing zeros beyond the exact value.
+    if (ndigits || (flags & FL_SPECIAL))
+    {
+        for (; ndigits > HEX_DIGITS; --ndigits)
+            *--p = '0';
+        for (; ndigits; --ndigits)
+        {
+            c = (char) (mant & 0x0f);
+            *--p = c + (c > 9 ? hexa : '0');
+            mant >>= 4;
+        }
+        *--p = '.';
+    }
+    *--p = lead + '0';
+
 #if FEATURE(USE_ZERO_PAD)
-                if (convert == '0')
-                {
-                    flags |= FL_ZERO_PAD;
-                }
-                else
+    // Zero padding goes between the 0x prefix and the digits.
+    if ((flags & FL_ZERO_PAD) && !(flags & FL_LEFT_JUST))
+    {
+        if (width > BUFMAX)
+            width = BUFMAX;
+        width -= (buf + BUFMAX - p) + 2;
+        if (flags & (FL_NEG | FL_PLUS | FL_SPACE))
+            --width;
+        for (; width > 0; --width)
+            *--p = '0';
+    }
+#else
+    (void) width;
 #endif
+    *--p = (fflags & FF_UCASE) ? 'X' : 'x';
+    *--p = '0';
+
+    // Add the sign prefix.
+    if      (flags & FL_NEG)    *--p = '-';
 #if FEATURE(USE_PLUS_SIGN)
-                if (convert == '+')
-                {
-                    flags |= FL_PLUS;
-                }
-                else
-#endif
-#if FEATURE(USE_LEFT_JUST)
-                if (convert == '-')
-                {
-                    flags |= FL_LEFT_JUST;
-                }
-                else
+    else if (flags & FL_PLUS)   *--p = '+';
 #endif
 #if FEATURE(USE_SPACE_SIGN)
-                if (convert == ' ')
-                {
-                    flags |= FL_SPACE;
-                }
-                else
-#endif
-#if FEATURE(USE_SPECIAL)
-                if (convert == '#')
-                {
-                    flags |= FL_SPECIAL;
-                }
-                else
+    else if (flags & FL_SPACE)  *--p = ' ';
 #endif
-                    break;
-            }
-#if FEATURE(USE_SPACE_PAD) || FEATURE(USE_ZERO_PAD)
-            // Extract width
-    #if FEATURE(USE_INDIRECT)
-            if (convert == '*')
-            {
-                width = va_arg(ap, int);
-                convert = GET_FORMAT(++fmt);
-            }
-            else
-    #endif
-            // cppcheck-suppress knownConditionTrueFalse    // False positive
-            while (convert >= '0' && convert <= '9')
-            {
-                width = width * 10 + convert - '0';
-                convert = GET_FORMAT(++fmt);
-            }
+
+    return p;       // Start of string
+}
 #endif
-#if FEATURE(USE_PRECISION)
-            // Extract precision
-            if (convert == '.')
+
+/*****************************************************************************
+Timestamp
+******************************************************************************/
+#if FEATURE(USE_TIMESTAMP)
+
+// Maximum number of fraction digits after the seconds.
+#define TIME_DIGITS_MAX 9
+
+// Write a two digit number into the buffer.
+static void put2(char *p, unsigned char n)
+{
+    p[0] = n / 10 + '0';
+    p[1] = n % 10 + '0';
+}
+
+/* ---------------------------------------------------------------------------
+Function: format_time()
+Called from the main doprnt function to format a timestamp in the form
+YYYY-MM-DDTHH:MM:SS with an optional fraction of a second.
+The text is kept in the caller's context together with the second and day
+it was built from. Consecutive calls within the same second only need the
+fraction, within the same minute only the seconds, and within the same day
+only the time of day. The calendar date is only worked out when the day
+changes.
+--------------------------------------------------------------------------- */
+static char *format_time(struct printf_time *tc, unsigned long secs, unsigned long frac,
+                         width_t ndigits)
+{
+    unsigned long day;
+    unsigned long tod;
+    unsigned long rem;
+    unsigned char i, digit;
+    char *p;
+
+    if (secs != tc->secs || tc->text[0] == '\0')
+    {
+        day = secs / 86400UL;
+        tod = secs - day * 86400UL;
+        if (day != tc->day || tc->text[0] == '\0')
+        {
+            /* Convert days since 1970-01-01 to a civil date.
+             * This is the civil_from_days algorithm by Howard Hinnant.
+             * Years start on 1st March so the leap day is at the end.
+             */
+            unsigned long z = day + 719468UL;
+            unsigned long era = z / 146097UL;
+            unsigned long doe = z - era * 146097UL;
+            unsigned long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+            unsigned long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+            unsigned char mp = (5 * doy + 2) / 153;
+            unsigned char month = mp < 10 ? mp + 3 : mp - 9;
+            unsigned year = yoe + era * 400 + (month <= 2);
+
+            put2(tc->text, year / 100);
+            put2(tc->text + 2, year % 100);
+            tc->text[4] = '-';
+            put2(tc->text + 5, month);
+            tc->text[7] = '-';
+            put2(tc->text + 8, doy - (153 * mp + 2) / 5 + 1);
+            tc->text[10] = 'T';
+            tc->text[13] = ':';
+            tc->text[16] = ':';
+            tc->day = day;
+            // Force the time of day to be updated.
+            tc->secs = secs + 60;
+        }
+        if (secs / 60 != tc->secs / 60)
+        {
+            put2(tc->text + 11, tod / 3600);
+            put2(tc->text + 14, tod / 60 % 60);
+        }
+        put2(tc->text + 17, tod % 60);
+        tc->secs = secs;
+    }
+
+    /* Add the fraction of a second, one digit at a time. Each digit is
+     * frac * 10 / rate, made by adding frac ten times so that nothing
+     * overflows for any rate, e.g. nanosecond ticks in a 32-bit long.
+     */
+    p = tc->text + 19;
+    if (ndigits > 0)
+    {
+        if (ndigits > TIME_DIGITS_MAX)
+            ndigits = TIME_DIGITS_MAX;
+        *p++ = '.';
+        do
+        {
+            rem = 0;
+            digit = 0;
+            for (i = 0; i < 10; i++)
             {
-                precision = 0;
-                convert = GET_FORMAT(++fmt);
-    #if FEATURE(USE_INDIRECT)
-                if (convert == '*')
+                // rem + frac >= rate, written so that it cannot wrap.
+                if (frac >= tc->rate - rem)
                 {
-                    precision = va_arg(ap, int);
-                    convert = GET_FORMAT(++fmt);
+                    rem = frac - (tc->rate - rem);
+                    ++digit;
                 }
                 else
-    #endif
-                while (convert >= '0' && convert <= '9')
-                {
-                    precision = precision * 10 + convert - '0';
-                    convert = GET_FORMAT(++fmt);
-                }
-            }
-#endif
-#if FEATURE(USE_LONG)
-            // Extract length modifier
-            if (convert == 'l')
-            {
-                convert = GET_FORMAT(++fmt);
-    #if FEATURE(USE_LONG_LONG)
-                if (convert == 'l')
                 {
-                    fflags |= FF_XLONG;
-                    convert = GET_FORMAT(++fmt);
+                    rem += frac;
                 }
-                else
-    #endif
-                flags |= FL_LONG;
             }
+            *p++ = (char) (digit + '0');
+            frac = rem;
+        }
+        while (--ndigits);
+    }
+    *p = '\0';
+
+    return tc->text;
+}
 #endif
-            switch (convert)
-            {
-#if FEATURE(USE_CHAR)
-            case 'c':
-    #if FEATURE(USE_SPACE_PAD)
-                width = 0;
+
+/*****************************************************************************
+Integer, character and string
+******************************************************************************/
+
+#if FEATURE(USE_INT128)
+/* ---------------------------------------------------------------------------
+Function: wide_chunk()
+Take the low digits of a 128-bit value into a 64-bit value, and return the
+number of digits taken, so the conversion can be done with 64-bit arithmetic.
+Decimal takes 19 digits with a single wide division, while hex and octal
+take 64 or 63 bits by shifting. Returns 0 when the rest of the value fits
+in 64 bits, or for binary which is limited to 32 bits.
+--------------------------------------------------------------------------- */
+static unsigned char wide_chunk(unsigned __int128 *wide, unsigned base, unsigned long long *low)
+{
+    unsigned __int128 rest;
+
+    if ((*wide >> 64) == 0 || base == 2)
+    {
+        *low = (unsigned long long) *wide;
+        return 0;
+    }
+    if (base == 10)
+    {
+        rest = *wide / 10000000000000000000ULL;
+        *low = (unsigned long long) (*wide - rest * 10000000000000000000ULL);
+        *wide = rest;
+        return 19;
+    }
+    if (base == 8)
+    {
+        *low = (unsigned long long) *wide & 0x7fffffffffffffffULL;
+        *wide >>= 63;
+        return 21;
+    }
+    *low = (unsigned long long) *wide;
+    *wide >>= 64;
+    return 16;
+}
+
+    #if HEX_CONVERT_ONLY
+        #define WIDE_CHUNK()    wide_chunk(&wvalue, 16, &uvalue)
+    #else
+        #define WIDE_CHUNK()    wide_chunk(&wvalue, base, &uvalue)
     #endif
-                *--p = (char) va_arg(ap, int);
-                break;
 #endif
-#if FEATURE(USE_SIGNED)
-            case 'd':
+
+#if FEATURE(USE_SPACE_PAD)
+/* ---------------------------------------------------------------------------
+Function: p_len()
+Helper function to find length of string.
+This offers a small space saving over strlen and allows for reading strings
+from flash where the micro uses different semantics to access program memory.
+This is used on the AVR processor.
+With PRINTF_WCET the length is only found up to the most that is output.
+--------------------------------------------------------------------------- */
+#ifdef PRINTF_WCET
+    #define P_LEN_FULL(len)     ((len) >= PRINTF_WCET_CHARS)
+#else
+    #define P_LEN_FULL(len)     0
 #endif
-#if FEATURE(USE_SIGNED_I)
-            case 'i':
+
+#if FEATURE(USE_FSTRING)
+static unsigned p_len(char *p, unsigned char flags)
+#else
+static unsigned p_len(char *p)
 #endif
-#if FEATURE(USE_SIGNED) || FEATURE(USE_SIGNED_I)
-                flags |= FL_NEG;    // Flag possible negative value, to be determined later
-                base = 10;
+{
+    unsigned len = 0;
+#if FEATURE(USE_FSTRING)
+    if (flags & FL_FSTR)
+    {
+    #ifdef GET_FORMAT_BLOCK
+        char block[FORMAT_BLOCK];
+        unsigned char i;
+
+        for (;;)
+        {
+            GET_FORMAT_BLOCK(block, p, FORMAT_BLOCK);
+            p += FORMAT_BLOCK;
+            for (i = 0; i < FORMAT_BLOCK; i++, len++)
+            {
+                if (block[i] == '\0' || P_LEN_FULL(len))
+                    return len;
+            }
+        }
+    #else
+        while (!P_LEN_FULL(len) && GET_FORMAT(p))
+        {
+            ++p;
+            ++len;
+        }
+    #endif
+    }
+    else
+#endif
+    {
+        while (!P_LEN_FULL(len) && *p++) ++len;
+    }
+    return len;
+}
+
+/* ---------------------------------------------------------------------------
+Function: lead_pad()
+Return the number of spaces before the text at p in a field of the given
+width, with the text cut to prec chars if prec is not negative. Only right
+justified fields have leading spaces. Used by doprnt() and printf_step().
+--------------------------------------------------------------------------- */
+static int lead_pad(char *p, unsigned char flags, width_t width, width_t prec)
+{
+    unsigned len;
+
+    if ((flags & FL_LEFT_JUST) || width <= 0)
+        return 0;
+#if FEATURE(USE_FSTRING)
+    len = p_len(p, flags);
+#else
+    len = p_len(p);
+#endif
+    if (prec >= 0 && (unsigned) prec < len)
+        len = (unsigned) prec;
+    return (len < (unsigned) width) ? width - (int) len : 0;
+}
+#endif
+
+/* ---------------------------------------------------------------------------
+Function: out_text()
+Output the text at p in one pass, up to limit chars if limit is not
+negative. Flash strings are read in blocks if GET_FORMAT_BLOCK is defined.
+Returns the number of chars output.
+--------------------------------------------------------------------------- */
+static unsigned out_text(OUT_PARAMS, const char *p, int limit, unsigned char flags)
+{
+    const char *start = p;
+    const char *end;
+    char c;
+#if FEATURE(USE_FSTRING) && defined(GET_FORMAT_BLOCK)
+    char block[FORMAT_BLOCK];
+    unsigned char i;
+#endif
+
+#ifdef PRINTF_WCET
+    // A long or unterminated string must not hold up the caller.
+    if (limit < 0 || limit > PRINTF_WCET_CHARS) limit = PRINTF_WCET_CHARS;
+#endif
+    end = (limit >= 0) ? p + limit : 0;
+#if FEATURE(USE_FSTRING) && defined(GET_FORMAT_BLOCK)
+    if (flags & FL_FSTR)
+    {
+        for (;;)
+        {
+            GET_FORMAT_BLOCK(block, p, FORMAT_BLOCK);
+            for (i = 0; i < FORMAT_BLOCK; i++, p++)
+            {
+                if (p == end || block[i] == '\0')
+                    return (unsigned) (p - start);
+                OUT(block[i]);
+            }
+        }
+    }
+#endif
+    (void) flags;
+    for (; p != end; ++p)
+    {
+#if FEATURE(USE_FSTRING)
+        if (flags & FL_FSTR)
+            c = GET_FORMAT(p);
+        else
+#endif
+        c = *p;
+        if (c == '\0') break;
+        OUT(c);
+    }
+    return (unsigned) (p - start);
+}
+
+#ifdef GET_FORMAT_BLOCK
+/*****************************************************************************
+Block format fetch
+
+Reading program memory one byte at a time is slow on some micros, so the
+format is copied a block at a time into a small window on the stack and
+read from there. A block may extend past the end of the format string.
+******************************************************************************/
+
+struct fmt_window
+{
+    const char *base;           // Format address of the first byte in data
+    char data[FORMAT_BLOCK];    // Copy of the format from base
+};
+
+/* ---------------------------------------------------------------------------
+Function: fmt_fetch()
+Return the format char at p, fetching the block starting at p if it is
+outside the window.
+--------------------------------------------------------------------------- */
+static char fmt_fetch(struct fmt_window *w, const char *p)
+{
+    if (p < w->base || p >= w->base + FORMAT_BLOCK)
+    {
+        w->base = p;
+        GET_FORMAT_BLOCK(w->data, p, FORMAT_BLOCK);
+    }
+    return w->data[p - w->base];
+}
+#endif
+
+#if FEATURE(USE_ESCAPE)
+/* ---------------------------------------------------------------------------
+Function: escape_seq()
+Give the output for one char of a string, escaped for JSON with %J or for
+a quoted CSV field with %Q. Returns the number of chars in the sequence.
+--------------------------------------------------------------------------- */
+static unsigned char escape_seq(char c, char convert, char *seq)
+{
+    unsigned char n = 1;
+
+    seq[0] = c;
+    if (convert == 'Q')
+    {
+        // A quote inside a field is doubled.
+        if (c == '"')
+            seq[n++] = '"';
+    }
+    else if (c == '"' || c == '\\')
+    {
+        seq[0] = '\\';
+        seq[n++] = c;
+    }
+    else if ((unsigned char) c < ' ')
+    {
+        seq[0] = '\\';
+        switch (c)
+        {
+        case '\b': seq[n++] = 'b'; break;
+        case '\f': seq[n++] = 'f'; break;
+        case '\n': seq[n++] = 'n'; break;
+        case '\r': seq[n++] = 'r'; break;
+        case '\t': seq[n++] = 't'; break;
+        default:
+            seq[1] = 'u';
+            seq[2] = '0';
+            seq[3] = '0';
+            seq[4] = (char) ('0' + (c >> 4));
+            seq[5] = (char) ((c & 15) < 10 ? '0' + (c & 15) : 'a' - 10 + (c & 15));
+            n = 6;
+            break;
+        }
+    }
+    return n;
+}
+
+/* ---------------------------------------------------------------------------
+Function: escape_text()
+Output a string escaped for %J or %Q, including the quotes for %Q. If limit
+is not negative it is the most chars of escaped text output, not counting
+the quotes, and an escape sequence is never split. If func is null nothing
+is output, so the length can be found for padding.
+Returns the number of chars output.
+--------------------------------------------------------------------------- */
+static unsigned escape_text(OUT_PARAMS, const char *p, char convert, int limit)
+{
+    char seq[6];
+    unsigned char n, i;
+    unsigned len = 0;
+
+#ifdef PRINTF_WCET
+    if (limit < 0 || limit > PRINTF_WCET_CHARS) limit = PRINTF_WCET_CHARS;
+#endif
+    if (convert == 'Q' && func)
+        OUT('"');
+    while (*p)
+    {
+        n = escape_seq(*p++, convert, seq);
+        if (limit >= 0 && len + n > (unsigned) limit)
+            break;
+        len += n;
+        if (func)
+        {
+            for (i = 0; i < n; i++)
+                OUT(seq[i]);
+        }
+    }
+    if (convert == 'Q')
+    {
+        if (func)
+            OUT('"');
+        len += 2;
+    }
+    return len;
+}
+
+/* ---------------------------------------------------------------------------
+Function: put_escaped()
+Output a string for %J or %Q padded to the width given.
+Returns the number of chars output.
+--------------------------------------------------------------------------- */
+static unsigned put_escaped(FILL_PARAMS, const char *p, char convert, int limit, width_t width, unsigned char flags)
+{
+    unsigned len = 0;
+    unsigned pad = 0;
+
+#if FEATURE(USE_SPACE_PAD)
+    if (width > 0)
+    {
+        len = escape_text(OUT_ARGS_NULL, p, convert, limit);
+        if ((unsigned) width > len)
+            pad = (unsigned) width - len;
+    }
+    if (!(flags & FL_LEFT_JUST))
+        fill_out(FILL_ARGS, ' ', (int) pad);
+#else
+    (void) width;
+    (void) flags;
+#endif
+    len = escape_text(OUT_ARGS, p, convert, limit);
+#if FEATURE(USE_SPACE_PAD)
+    if (flags & FL_LEFT_JUST)
+        fill_out(FILL_ARGS, ' ', (int) pad);
+#endif
+    return len + pad;
+}
+#endif
+
+#if FEATURE(USE_CUSTOM)
+/*****************************************************************************
+Custom conversions
+******************************************************************************/
+
+// Table of registered conversion letters and their functions.
+static struct
+{
+    char convert;
+    printf_conv_t func;
+} custom_conv[CUSTOM_MAX];
+
+// Chars taken by the parser, which can never reach a custom conversion.
+static const char parse_chars[] FLASH_TABLE = "%0123456789-+ #.*lw";
+
+#if !FEATURE(USE_FORMAT_TABLE)
+// Conversion letters built in with the features selected.
+static const char builtin_chars[] FLASH_TABLE = ""
+    #if FEATURE(USE_CHAR)
+    "c"
+    #endif
+    #if FEATURE(USE_SIGNED)
+    "d"
+    #endif
+    #if FEATURE(USE_SIGNED_I)
+    "i"
+    #endif
+    #if FEATURE(USE_UNSIGNED)
+    "u"
+    #endif
+    #if FEATURE(USE_OCTAL)
+    "o"
+    #endif
+    #if FEATURE(USE_BINARY)
+    "b"
+    #endif
+    #if FEATURE(USE_HEX_LOWER)
+    "x"
+    #endif
+    #if FEATURE(USE_HEX_UPPER)
+    "X"
+    #endif
+    #if FEATURE(USE_FLOAT)
+    "feEgG"
+    #endif
+    #if FEATURE(USE_HEX_FLOAT)
+    "aA"
+    #endif
+    #if FEATURE(USE_TIMESTAMP)
+    "T"
+    #endif
+    #if FEATURE(USE_ESCAPE)
+    "JQ"
+    #endif
+    #if FEATURE(USE_STRING)
+    "s"
+        #if FEATURE(USE_FSTRING)
+    "S"
+        #endif
+    #endif
+    ;
+#endif
+
+/* ---------------------------------------------------------------------------
+Function: in_chars()
+Return non-zero if c is one of the chars in the table given.
+--------------------------------------------------------------------------- */
+static char in_chars(const char *table, char c)
+{
+    char t;
+
+    while ((t = (char) GET_TABLE_BYTE(table++)) != '\0')
+    {
+        if (t == c)
+            return 1;
+    }
+    return 0;
+}
+
+/* ---------------------------------------------------------------------------
+Function: printf_register()
+Register a function to handle a conversion letter which is not built in.
+Registering the same letter again replaces the function, and a null function
+removes it. Letters used by the built-in conversions with the features
+selected, and the flag, width, precision and length chars, cannot be used.
+Returns 0 on success or -1 if the letter cannot be used or the table is full.
+Registration is not thread-safe, so do it before any printf calls are made.
+--------------------------------------------------------------------------- */
+int printf_register(char convert, printf_conv_t func)
+{
+    unsigned char i;
+    unsigned char slot = CUSTOM_MAX;
+
+    // doprnt() never reaches the custom table for these.
+    if (convert == '\0' || in_chars(parse_chars, convert))
+        return -1;
+#if FEATURE(USE_FORMAT_TABLE)
+    if (FMT_CLASS(convert) & CT_CONV)
+        return -1;
+#else
+    if (in_chars(builtin_chars, convert))
+        return -1;
+#endif
+
+    for (i = 0; i < CUSTOM_MAX; i++)
+    {
+        if (custom_conv[i].convert == convert)
+        {
+            slot = i;
+            break;
+        }
+        if (custom_conv[i].convert == '\0' && slot == CUSTOM_MAX)
+            slot = i;
+    }
+    if (slot == CUSTOM_MAX)
+        return -1;
+    custom_conv[slot].convert = func ? convert : '\0';
+    custom_conv[slot].func = func;
+    return 0;
+}
+
+/* ---------------------------------------------------------------------------
+Function: find_custom()
+Return the function registered for a conversion letter, or null if none.
+--------------------------------------------------------------------------- */
+static printf_conv_t find_custom(char convert)
+{
+    unsigned char i;
+
+    for (i = 0; i < CUSTOM_MAX; i++)
+    {
+        if (custom_conv[i].convert == convert)
+            return custom_conv[i].func;
+    }
+    return 0;
+}
+#endif
+
+#if FEATURE(USE_STATS)
+/*****************************************************************************
+Instrumentation
+******************************************************************************/
+
+// Accumulated counts, indexed by PRINTF_STAT_xxx.
+static struct printf_stat stats[PRINTF_STAT_MAX];
+
+/* ---------------------------------------------------------------------------
+Function: printf_stats_snapshot()
+Copy the accumulated counts into the caller's array of PRINTF_STAT_MAX entries.
+The copy is not atomic, so take it when no printf call can be in progress.
+--------------------------------------------------------------------------- */
+void printf_stats_snapshot(struct printf_stat *snap)
+{
+    unsigned char i;
+
+    for (i = 0; i < PRINTF_STAT_MAX; i++)
+        snap[i] = stats[i];
+}
+
+/* ---------------------------------------------------------------------------
+Function: printf_stats_reset()
+Clear all the accumulated counts.
+--------------------------------------------------------------------------- */
+void printf_stats_reset(void)
+{
+    unsigned char i;
+
+    for (i = 0; i < PRINTF_STAT_MAX; i++)
+    {
+        stats[i].calls = 0;
+        stats[i].bytes = 0;
+        stats[i].cycles = 0;
+    }
+}
+#endif
+
+#if defined(PRINTF_CBOR) && !defined(BASIC_PRINTF_ONLY)
+/*****************************************************************************
+CBOR output
+
+doprnt() parses the format in the usual way, but when the output function
+is putcbor() each argument is encoded as a CBOR item instead of as text.
+Literal text goes to putcbor(), which keeps the letters, digits and '_'
+as the key for the next item. Items with no key use their position.
+******************************************************************************/
+
+#if FEATURE(USE_LONG_LONG)
+    typedef unsigned long long cbor_uint_t;
+#elif FEATURE(USE_LONG)
+    typedef unsigned long cbor_uint_t;
+#else
+    typedef unsigned cbor_uint_t;
+#endif
+
+struct cbor_out
+{
+    unsigned char *buf;         // Output buffer
+    unsigned size;              // Size of the buffer
+    unsigned len;               // Bytes generated, which may be more than size
+    unsigned char index;        // Position of the next item
+    unsigned char klen;         // Length of the key so far
+    char key[PRINTF_CBOR_KEY];  // Key for the next item
+};
+
+/* ---------------------------------------------------------------------------
+Function: cbor_byte()
+Add a byte to the output, if there is space.
+--------------------------------------------------------------------------- */
+static void cbor_byte(struct cbor_out *cb, unsigned char c)
+{
+    if (cb->len < cb->size)
+        cb->buf[cb->len] = c;
+    cb->len++;
+}
+
+/* ---------------------------------------------------------------------------
+Function: cbor_head()
+Add the head of an item with its major type and argument, using the
+shortest encoding of the argument.
+--------------------------------------------------------------------------- */
+static void cbor_head(struct cbor_out *cb, unsigned char major, cbor_uint_t n)
+{
+    unsigned char len;
+
+    if (n < 24)
+    {
+        cbor_byte(cb, (unsigned char) ((major << 5) | n));
+        return;
+    }
+    if (n <= 0xff)
+        len = 0;
+    else if (n <= 0xffff)
+        len = 1;
+    // Shift in two steps so it is valid for a 16-bit type.
+    else if ((n >> 16 >> 16) == 0)
+        len = 2;
+    else
+        len = 3;
+    cbor_byte(cb, (unsigned char) ((major << 5) | (24 + len)));
+    for (len = (unsigned char) (1 << len); len--; )
+        cbor_byte(cb, (unsigned char) (n >> (8 * len)));
+}
+
+/* ---------------------------------------------------------------------------
+Function: cbor_key()
+Add the key for the next item: the text collected, or else the position.
+--------------------------------------------------------------------------- */
+static void cbor_key(struct cbor_out *cb)
+{
+    unsigned char i;
+
+    if (cb->klen)
+    {
+        cbor_head(cb, 3, cb->klen);
+        for (i = 0; i < cb->klen; i++)
+            cbor_byte(cb, (unsigned char) cb->key[i]);
+    }
+    else
+    {
+        cbor_head(cb, 0, cb->index);
+    }
+    cb->index++;
+    cb->klen = 0;
+}
+
+/* ---------------------------------------------------------------------------
+Function: putcbor()
+This is the output function used for printf_cbor.
+Literal text is not output, but key chars are kept for the next item.
+--------------------------------------------------------------------------- */
+static void putcbor(char c, void *context)
+{
+    struct cbor_out *cb = (struct cbor_out *) context;
+
+    if (((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_') &&
+        cb->klen < PRINTF_CBOR_KEY)
+    {
+        cb->key[cb->klen++] = c;
+    }
+}
+
+/* ---------------------------------------------------------------------------
+Function: cbor_int()
+Add an integer item. The value is the magnitude and neg gives the sign.
+--------------------------------------------------------------------------- */
+static void cbor_int(struct cbor_out *cb, cbor_uint_t value, unsigned char neg)
+{
+    cbor_key(cb);
+    if (neg)
+        cbor_head(cb, 1, value - 1);
+    else
+        cbor_head(cb, 0, value);
+}
+
+/* ---------------------------------------------------------------------------
+Function: cbor_text()
+Add the text of a conversion as a byte string, up to precision chars if
+it is not negative.
+--------------------------------------------------------------------------- */
+static void cbor_text(struct cbor_out *cb, const char *p, unsigned char flags, width_t precision)
+{
+    unsigned len = 0;
+    char c;
+
+    for (;;)
+    {
+#if FEATURE(USE_FSTRING)
+        if (flags & FL_FSTR)
+            c = GET_FORMAT(p + len);
+        else
+#endif
+        c = p[len];
+        if (c == '\0' || (precision >= 0 && len >= (unsigned) precision))
+            break;
+        len++;
+    }
+    (void) flags;
+    cbor_key(cb);
+    cbor_head(cb, 2, len);
+    while (len--)
+    {
+#if FEATURE(USE_FSTRING)
+        if (flags & FL_FSTR)
+            c = GET_FORMAT(p);
+        else
+#endif
+        c = *p;
+        ++p;
+        cbor_byte(cb, (unsigned char) c);
+    }
+}
+
+    #if FEATURE(USE_FLOAT) || FEATURE(USE_HEX_FLOAT)
+/* ---------------------------------------------------------------------------
+Function: cbor_half()
+Find the half precision bits for a value, if it can be held exactly.
+Returns 1 if it can, otherwise 0.
+--------------------------------------------------------------------------- */
+static unsigned char cbor_half(double number, unsigned *half)
+{
+    unsigned sign = 0;
+    double m;
+    int exp;
+
+    if (number != number)
+    {
+        *half = 0x7e00;     // NaN
+        return 1;
+    }
+    if (number < 0)
+    {
+        sign = 0x8000;
+        number = -number;
+    }
+    if (number - number != 0)
+    {
+        *half = sign | 0x7c00;  // Infinity
+        return 1;
+    }
+    if (number == 0)
+    {
+        *half = sign;
+        return 1;
+    }
+    m = frexp(number, &exp);
+    if (exp > 16)
+        return 0;
+    if (exp >= -13)
+    {
+        // Normal, with 11 significant bits including the hidden bit.
+        m *= 2048;
+        if (m != (double) (unsigned) m)
+            return 0;
+        *half = sign | ((unsigned) (exp + 14) << 10) | ((unsigned) m - 1024);
+        return 1;
+    }
+    // Subnormal, in units of 2^-24.
+    m = ldexp(number, 24);
+    if (m != (double) (unsigned) m)
+        return 0;
+    *half = sign | (unsigned) m;
+    return 1;
+}
+
+/* ---------------------------------------------------------------------------
+Function: cbor_float()
+Add a floating point item in the smallest of half, single or double
+precision which holds the value exactly.
+--------------------------------------------------------------------------- */
+static void cbor_float(struct cbor_out *cb, double number)
+{
+    union
+    {
+        float f;
+        unsigned char c[sizeof(float)];
+    } f;
+    union
+    {
+        double d;
+        unsigned char c[sizeof(double)];
+    } d;
+    unsigned half;
+    unsigned char i, big;
+
+    cbor_key(cb);
+    if (cbor_half(number, &half))
+    {
+        cbor_byte(cb, 0xf9);
+        cbor_byte(cb, (unsigned char) (half >> 8));
+        cbor_byte(cb, (unsigned char) half);
+        return;
+    }
+    // The bytes are sent most significant first, whatever the byte order of the host.
+    f.f = 1.0f;
+    big = (f.c[0] != 0);
+    f.f = (float) number;
+    if ((double) f.f == number || sizeof(double) == sizeof(float))
+    {
+        cbor_byte(cb, 0xfa);
+        for (i = 0; i < sizeof(float); i++)
+            cbor_byte(cb, f.c[big ? i : sizeof(float) - 1 - i]);
+        return;
+    }
+    d.d = number;
+    cbor_byte(cb, 0xfb);
+    for (i = 0; i < sizeof(double); i++)
+        cbor_byte(cb, d.c[big ? i : sizeof(double) - 1 - i]);
+}
+    #endif
+#endif
+
+/* ---------------------------------------------------------------------------
+Function: doprnt()
+This is the main worker function which does all the formatting.
+The output function must always be provided.
+Unless BASIC_PRINTF is defined it also needs the context variable,
+which tells the output function where to write.
+The argument list is passed by pointer so that it can be handed on to custom
+conversions and so that printf_step() can take one argument at a time.
+With USE_STATS each conversion is timed from its '%' to the end of its output,
+so the time spent in the output function is included.
+For printf_step() the output function is null and the context is the step
+context. Only the conversion at fmt is done and its text is left in the
+context for printf_step() to output.
+--------------------------------------------------------------------------- */
+#if defined(PRINTF_STEP) && !defined(BASIC_PRINTF_ONLY)
+    #define STEP_CALL   (func == 0)
+#else
+    #define STEP_CALL   0
+#endif
+#if defined(PRINTF_STEP) && !defined(BASIC_PRINTF_ONLY) && FEATURE(USE_ESCAPE)
+static void putbuf(char c, void *context);
+#endif
+#if defined(PRINTF_CBOR) && !defined(BASIC_PRINTF_ONLY)
+    #define CBOR_CALL   (func == putcbor)
+#endif
+#ifdef BASIC_PRINTF_ONLY
+static printf_t doprnt(void (*func)(char c), const char *fmt, va_list *ap)
+#else
+static printf_t doprnt(void *context, void (*func)(char c, void *context),
+                       void (*fill)(char c, width_t n, void *context), const char *fmt, va_list *ap)
+#endif
+{
+#if defined(PRINTF_STEP) && !defined(BASIC_PRINTF_ONLY)
+    struct printf_step *step;
+    char *q;
+#endif
+#if FEATURE(USE_CUSTOM)
+    printf_conv_t cfunc;
+    struct printf_spec spec;
+#endif
+#if INT_CONVERT
+    #if FEATURE(USE_LONG_LONG)
+    unsigned long long uvalue;
+    #elif FEATURE(USE_LONG)
+    unsigned long uvalue;
+    #else
+    unsigned uvalue;
+    #endif
+#endif
+#if FEATURE(USE_INT128)
+    unsigned __int128 wvalue;
+    unsigned char digits;
+#endif
+#if !HEX_CONVERT_ONLY
+    unsigned base;
+#endif
+#if FEATURE(USE_SPACE_PAD) || FEATURE(USE_ZERO_PAD) || FEATURE(USE_FLOAT)
+    width_t width;
+#endif
+    int fwidth;
+#if FEATURE(USE_PRECISION) || FEATURE(USE_FLOAT)
+    width_t precision;
+#else
+    #define precision -1
+#endif
+    char convert;
+#if INT_CONVERT
+    char c;
+#endif
+#if FEATURE(USE_FORMAT_TABLE)
+    unsigned char ctype;
+#endif
+    char *p;
+    char buffer[BUFMAX+1];
+#ifdef GET_FORMAT_BLOCK
+    struct fmt_window window;
+#endif
+#ifdef PRINTF_T
+    printf_t count = 0;
+#endif
+    unsigned char flags;
+#if FEATURE(USE_FLOAT) || FEATURE(USE_LONG_LONG) || FEATURE(USE_HEX_FLOAT)
+    unsigned char fflags;
+#endif
+#if FEATURE(USE_FLOAT) || FEATURE(USE_HEX_FLOAT)
+    double fvalue;
+#endif
+#if FEATURE(USE_TIMESTAMP)
+    struct printf_time *tc;
+    #if FEATURE(USE_LONG_LONG)
+    unsigned long long ticks;
+    #else
+    unsigned long ticks;
+    #endif
+#endif
+#if FEATURE(USE_STATS)
+    unsigned char stat;
+    unsigned sbytes;
+    unsigned long tconv;
+    unsigned long tcall = PRINTF_STATS_TIME();
+#endif
+
+#if !FEATURE(USE_SPACE_PAD) && !FEATURE(USE_EXACT_FLOAT) && !defined(BASIC_PRINTF_ONLY)
+    (void) fill;        // Only used for padding.
+#endif
+    buffer[BUFMAX] = '\0';
+#ifdef GET_FORMAT_BLOCK
+    window.base = fmt;
+    GET_FORMAT_BLOCK(window.data, fmt, FORMAT_BLOCK);
+#endif
+
+    for (;;)
+    {
+        convert = FORMAT_CHAR(fmt);
+        if (convert == 0) break;
+        if (convert == '%')
+        {
+#if FEATURE(USE_STATS)
+            tconv = PRINTF_STATS_TIME();
+            stat = PRINTF_STAT_OTHER;
+            sbytes = 0;
+#endif
+            p = buffer + BUFMAX;
+#if FEATURE(USE_PRECISION) || FEATURE(USE_FLOAT)
+            precision = -1;
+#endif
+#if FEATURE(USE_SPACE_PAD) || FEATURE(USE_ZERO_PAD) || FEATURE(USE_FLOAT)
+            width = 0;
+#endif
+#if FEATURE(USE_FLOAT) || FEATURE(USE_LONG_LONG) || FEATURE(USE_HEX_FLOAT)
+            fflags = 0;
+#endif
+            flags = 0;
+
+            // Extract flag chars
+#if FEATURE(USE_FORMAT_TABLE)
+            while ((NEXT_FORMAT() & (CT_CONV | CT_FLAG)) == CT_FLAG)
+            {
+                flags |= ctype & CT_FLAGS;
+            }
+#else
+            for (;;)
+            {
+                convert = FORMAT_CHAR(++fmt);
+#if FEATURE(USE_ZERO_PAD)
+                if (convert == '0')
+                {
+                    flags |= FL_ZERO_PAD;
+                }
+                else
+#endif
+#if FEATURE(USE_PLUS_SIGN)
+                if (convert == '+')
+                {
+                    flags |= FL_PLUS;
+                }
+                else
+#endif
+#if FEATURE(USE_LEFT_JUST)
+                if (convert == '-')
+                {
+                    flags |= FL_LEFT_JUST;
+                }
+                else
+#endif
+#if FEATURE(USE_SPACE_SIGN)
+                if (convert == ' ')
+                {
+                    flags |= FL_SPACE;
+                }
+                else
+#endif
+#if FEATURE(USE_SPECIAL)
+                if (convert == '#')
+                {
+                    flags |= FL_SPECIAL;
+                }
+                else
+#endif
+                    break;
+            }
+#endif
+#if FEATURE(USE_SPACE_PAD) || FEATURE(USE_ZERO_PAD)
+            // Extract width
+    #if FEATURE(USE_INDIRECT)
+            if (convert == '*')
+            {
+                width = va_arg(*ap, int);
+                NEXT_FORMAT();
+            }
+            else
+    #endif
+            // cppcheck-suppress knownConditionTrueFalse    // False positive
+            while (IS_DIGIT())
+            {
+                width = width * 10 + convert - '0';
+                NEXT_FORMAT();
+            }
+#endif
+#if FEATURE(USE_PRECISION)
+            // Extract precision
+            if (convert == '.')
+            {
+                precision = 0;
+                NEXT_FORMAT();
+    #if FEATURE(USE_INDIRECT)
+                if (convert == '*')
+                {
+                    precision = va_arg(*ap, int);
+                    NEXT_FORMAT();
+                }
+                else
+    #endif
+                while (IS_DIGIT())
+                {
+                    precision = precision * 10 + convert - '0';
+                    NEXT_FORMAT();
+                }
+            }
+#endif
+#ifdef PRINTF_WCET
+            // Limit the work done for this conversion.
+    #if FEATURE(USE_SPACE_PAD) || FEATURE(USE_ZERO_PAD)
+            if (width > PRINTF_WCET_CHARS) width = PRINTF_WCET_CHARS;
+    #endif
+    #if FEATURE(USE_PRECISION)
+            if (precision > PRINTF_WCET_CHARS) precision = PRINTF_WCET_CHARS;
+    #endif
+#endif
+#if FEATURE(USE_LONG)
+            // Extract length modifier
+            if (IS_LENGTH())
+            {
+                NEXT_FORMAT();
+    #if FEATURE(USE_LONG_LONG)
+                if (IS_LENGTH())
+                {
+                    fflags |= FF_XLONG;
+                    NEXT_FORMAT();
+                }
+                else
+    #endif
+                flags |= FL_LONG;
+            }
+#endif
+#if FEATURE(USE_INT128)
+            // Exact width length modifier, w128 and those widths matching a supported type.
+            if (convert == 'w')
+            {
+                NEXT_FORMAT();
+                digits = 0;
+                while (IS_DIGIT())
+                {
+                    // Saturate so that no large width can wrap to a valid one.
+                    digits = (unsigned char) (digits >= 25 ? 255 : digits * 10 + convert - '0');
+                    NEXT_FORMAT();
+                }
+                if (digits == 128)
+                    fflags |= FF_XLONG | FF_X128;
+                else if (digits == 64)
+                    fflags |= FF_XLONG;
+    #if UINT_MAX == 0xFFFFFFFFUL
+                else if (digits == 32)
+                    ;
+    #elif ULONG_MAX == 0xFFFFFFFFUL
+                else if (digits == 32)
+                    flags |= FL_LONG;
+    #endif
+                else
+                {
+                    // No matching type, so output the text as for an unknown conversion.
+                    while (convert != 'w')
+                        convert = FORMAT_CHAR(--fmt);
+    #if FEATURE(USE_FORMAT_TABLE)
+                    ctype = FMT_CLASS(convert);
+    #endif
+                }
+            }
+#endif
+#if FEATURE(USE_FORMAT_TABLE)
+            switch (CT_CASE(ctype))
+#else
+            switch (convert)
+#endif
+            {
+#if FEATURE(USE_CHAR)
+            case CONV_CASE('c', CT_CHAR):
+    #if FEATURE(USE_SPACE_PAD)
+                width = 0;
+    #endif
+    #if FEATURE(USE_STATS)
+                stat = PRINTF_STAT_CHAR;
+    #endif
+                *--p = (char) va_arg(*ap, int);
+                break;
+#endif
+#if FEATURE(USE_FORMAT_TABLE)
+    #if !HEX_CONVERT_ONLY
+            case CT_INT:
+                // The table gives the base and whether the conversion is signed.
+                base = ctype & CT_BASE;
+        #if FEATURE(USE_SIGNED) || FEATURE(USE_SIGNED_I)
+                if (ctype & CT_SIGNED)
+                    flags |= FL_NEG;    // Flag possible negative value, to be determined later
+        #endif
+    #elif FEATURE(USE_HEX_LOWER) || FEATURE(USE_HEX_UPPER)
+            case CT_INT:
+    #endif
+#else
+#if FEATURE(USE_SIGNED)
+            case 'd':
+#endif
+#if FEATURE(USE_SIGNED_I)
+            case 'i':
+#endif
+#if FEATURE(USE_SIGNED) || FEATURE(USE_SIGNED_I)
+                flags |= FL_NEG;    // Flag possible negative value, to be determined later
+                base = 10;
                 goto number;
 #endif
 #if FEATURE(USE_UNSIGNED)
@@ -817,32 +2711,53 @@ static printf_t doprnt(void *context, void (*func)(char c, void *context), const
                 base = 16;
     #endif
 #endif
-#if !HEX_CONVERT_ONLY
+#endif
+#if !HEX_CONVERT_ONLY && !FEATURE(USE_FORMAT_TABLE)
             number:
 #endif
+#if INT_CONVERT
+    #if FEATURE(USE_STATS)
+                stat = PRINTF_STAT_INT;
+    #endif
                 /* Using separate va_arg() calls for signed and unsigned types is expensive.
                    Instead, values are read as unsigned, regardless of signed/unsigned type.
                    Signed values then need to be sign-extended
                    and this is fixed after the check for negative numbers.
                 */
-#if FEATURE(USE_LONG)
-    #if FEATURE(USE_LONG_LONG)
+    #if FEATURE(USE_INT128)
+                digits = 0;
+                if (fflags & FF_X128)
+                {
+                    wvalue = va_arg(*ap, unsigned __int128);
+        #if FEATURE(USE_SIGNED) || FEATURE(USE_SIGNED_I)
+                    // FL_NEG was used temporarily to indicate signed type
+                    if ((flags & FL_NEG) && (__int128) wvalue < 0)
+                        wvalue = -wvalue;
+                    else
+        #endif
+                        flags &= ~FL_NEG;
+                    digits = WIDE_CHUNK();
+                    goto wide_number;
+                }
+    #endif
+    #if FEATURE(USE_LONG)
+        #if FEATURE(USE_LONG_LONG)
                 if (fflags & FF_XLONG)
-                    uvalue = va_arg(ap, unsigned long long);
+                    uvalue = va_arg(*ap, unsigned long long);
                 else
-    #endif
+        #endif
                 if (flags & FL_LONG)
-                    uvalue = va_arg(ap, unsigned long);
+                    uvalue = va_arg(*ap, unsigned long);
                 else
-#endif
-                    uvalue = va_arg(ap, unsigned int);
-#if FEATURE(USE_SIGNED) || FEATURE(USE_SIGNED_I)
+    #endif
+                    uvalue = va_arg(*ap, unsigned int);
+    #if FEATURE(USE_SIGNED) || FEATURE(USE_SIGNED_I)
                 // FL_NEG was used temporarily to indicate signed type
                 if (flags & FL_NEG)
                 {
                     // Values may need to be sign extended if not the widest type.
-    #if FEATURE(USE_LONG)
-        #if FEATURE(USE_LONG_LONG)
+        #if FEATURE(USE_LONG)
+            #if FEATURE(USE_LONG_LONG)
                     if (!(fflags & FF_XLONG))
                     {
                         if (!(flags & FL_LONG))
@@ -850,21 +2765,21 @@ static printf_t doprnt(void *context, void (*func)(char c, void *context), const
                         else
                             uvalue = (long) uvalue;
                     }
-        #else
+            #else
                     if (!(flags & FL_LONG))
                         uvalue = (int) uvalue;
+            #endif
         #endif
-    #endif
                     // Check whether this is a negative value
-    #if FEATURE(USE_LONG)
-        #if FEATURE(USE_LONG_LONG)
+        #if FEATURE(USE_LONG)
+            #if FEATURE(USE_LONG_LONG)
                     if ((long long) uvalue < 0)
-        #else
+            #else
                     if ((long) uvalue < 0)
-        #endif
-    #else
+            #endif
+        #else
                     if ((int) uvalue < 0)
-    #endif
+        #endif
                     {
                         uvalue = -uvalue;   // Yes, it's negative
                     }
@@ -873,93 +2788,122 @@ static printf_t doprnt(void *context, void (*func)(char c, void *context), const
                         flags &= ~FL_NEG;   // No, it's positive
                     }
                 }
-#endif
-#if FEATURE(USE_PRECISION)
+    #endif
+    #if defined(PRINTF_CBOR) && !defined(BASIC_PRINTF_ONLY)
+                if (CBOR_CALL)
+                {
+                    cbor_int((struct cbor_out *) context, uvalue, flags & FL_NEG);
+                    goto conv_done;
+                }
+    #endif
+    #if FEATURE(USE_INT128)
+            wide_number: ;
+    #endif
+    #if FEATURE(USE_PRECISION)
                 // Set default precision
                 if (precision == -1) precision = 1;
-#endif
+                // Avoid formatting buffer overflow, leaving room for the prefix.
+                if (precision > BUFMAX - 3) precision = BUFMAX - 3;
+    #endif
                 // Make sure options are valid.
-#if HEX_CONVERT_ONLY
-    #if FEATURE(USE_PLUS_SIGN) || FEATURE(USE_SPACE_SIGN)
+    #if HEX_CONVERT_ONLY
+        #if FEATURE(USE_PLUS_SIGN) || FEATURE(USE_SPACE_SIGN)
                 flags &= ~(FL_PLUS|FL_SPACE);
-    #endif
-#else
+        #endif
+    #else
                 if (base != 10) flags &= ~(FL_PLUS|FL_NEG|FL_SPACE);
-    #if FEATURE(USE_SPECIAL)
+        #if FEATURE(USE_SPECIAL)
                 else            flags &= ~FL_SPECIAL;
+        #endif
     #endif
-#endif
                 // Generate the number without any prefix yet.
-#if FEATURE(USE_ZERO_PAD)
+    #if FEATURE(USE_ZERO_PAD)
                 fwidth = width;
                 // Avoid formatting buffer overflow.
                 if (fwidth > BUFMAX) fwidth = BUFMAX;
-#endif
-#if FEATURE(USE_LONG_LONG) && FEATURE(USE_BINARY)
+    #endif
+    #if FEATURE(USE_LONG_LONG) && FEATURE(USE_BINARY)
                 // 64-bit binary output is impractical for reading and requires a huge buffer.
                 // Restrict to 32 bits in binary mode.
                 if ((base == 2) && (fflags & FF_XLONG))
                 {
-                    uvalue = (unsigned long) uvalue;
+                    uvalue &= 0xffffffffUL;
                 }
-#endif
-#if FEATURE(USE_PRECISION)
+    #endif
+    #if FEATURE(USE_PRECISION)
+        #if FEATURE(USE_INT128)
+                while (uvalue || precision > 0 || digits)
+        #else
                 while (uvalue || precision > 0)
-#else
+        #endif
+    #else
+        #if FEATURE(USE_INT128)
+                if (uvalue == 0 && digits == 0)
+        #else
                 if (uvalue == 0)
+        #endif
                 {
                     // Avoid printing 0 as ' '
                     *--p = '0';
-    #if FEATURE(USE_ZERO_PAD)
+        #if FEATURE(USE_ZERO_PAD)
                     --fwidth;
-    #endif
+        #endif
                 }
+        #if FEATURE(USE_INT128)
+                while (uvalue || digits)
+        #else
                 while (uvalue)
-#endif
+        #endif
+    #endif
                 {
-#if HEX_CONVERT_ONLY
+    #if HEX_CONVERT_ONLY
                     c = (char) ((uvalue & 0x0f) + '0');
-#else
+    #else
                     c = (char) ((uvalue % base) + '0');
-#endif
-#if FEATURE(USE_HEX_LOWER) || FEATURE(USE_HEX_UPPER)
+    #endif
+    #if FEATURE(USE_HEX_LOWER) || FEATURE(USE_HEX_UPPER)
                     if (c > '9')
                     {
                         // Hex digits
-    #if FEATURE(USE_HEX_LOWER) && FEATURE(USE_HEX_UPPER)
+        #if FEATURE(USE_HEX_LOWER) && FEATURE(USE_HEX_UPPER)
                         if (convert == 'X') c += 'A' - '0' - 10;
                         else                c += 'a' - '0' - 10;
-    #elif FEATURE(USE_HEX_UPPER) || FEATURE(USE_HEX_UPPER_L)
+        #elif FEATURE(USE_HEX_UPPER) || FEATURE(USE_HEX_UPPER_L)
                         c += 'A' - '0' - 10;
-    #else
+        #else
                         c += 'a' - '0' - 10;
-    #endif
+        #endif
                     }
-#endif
+    #endif
                     *--p = c;
-#if HEX_CONVERT_ONLY
+    #if HEX_CONVERT_ONLY
                     uvalue >>= 4;
-#else
+    #else
                     uvalue /= base;
-#endif
-#if FEATURE(USE_ZERO_PAD)
+    #endif
+    #if FEATURE(USE_ZERO_PAD)
                     --fwidth;
-#endif
-#if FEATURE(USE_PRECISION)
+    #endif
+    #if FEATURE(USE_PRECISION)
                     --precision;
-#endif
+    #endif
+    #if FEATURE(USE_INT128)
+                    // Take the next chunk once all the digits of this one are done.
+                    if (digits && --digits == 0)
+                        digits = WIDE_CHUNK();
+    #endif
                 }
-#if FEATURE(USE_ZERO_PAD)
+    #if FEATURE(USE_ZERO_PAD)
                 // Allocate space for the sign bit.
                 if (flags & (FL_PLUS|FL_NEG|FL_SPACE)) --fwidth;
-    #if FEATURE(USE_SPECIAL)
+        #if FEATURE(USE_SPECIAL)
                 // Allocate space for special chars if required.
                 if (flags & FL_SPECIAL)
                 {
                     if (convert == 'o') fwidth -= 1;
                     else fwidth -= 2;
                 }
-    #endif
+        #endif
                 // Add leading zero padding if required.
                 if ((flags & FL_ZERO_PAD) && !(flags & FL_LEFT_JUST))
                 {
@@ -969,29 +2913,34 @@ static printf_t doprnt(void *context, void (*func)(char c, void *context), const
                         --fwidth;
                     }
                 }
-#endif
-#if FEATURE(USE_SPECIAL)
+    #endif
+    #if FEATURE(USE_SPECIAL)
                 // Add special prefix if required.
                 if (flags & FL_SPECIAL)
                 {
                     if (convert != 'o') *--p = convert;
                     *--p = '0';
                 }
-#endif
+    #endif
                 // Add the sign prefix
                 if      (flags & FL_NEG)    *--p = '-';
-#if FEATURE(USE_PLUS_SIGN)
+    #if FEATURE(USE_PLUS_SIGN)
                 else if (flags & FL_PLUS)   *--p = '+';
-#endif
-#if FEATURE(USE_SPACE_SIGN)
+    #endif
+    #if FEATURE(USE_SPACE_SIGN)
                 else if (flags & FL_SPACE)  *--p = ' ';
-#endif
-#if FEATURE(USE_PRECISION)
+    #endif
+    #if FEATURE(USE_PRECISION)
                 // Precision is not used to limit number output.
                 precision = -1;
-#endif
+    #endif
                 break;
+#endif
 #if FEATURE(USE_FLOAT)
+    #if FEATURE(USE_FORMAT_TABLE)
+            case CT_FLT:
+                fflags = ctype & CT_FFLAGS;
+    #else
             case 'f':
                 fflags = FF_FCVT;
                 goto fp_number;
@@ -1005,198 +2954,1198 @@ static printf_t doprnt(void *context, void (*func)(char c, void *context), const
             case 'g':
                 fflags |= FF_GCVT;
             fp_number:
+    #endif
+    #if FEATURE(USE_STATS)
+                stat = PRINTF_STAT_FLOAT;
+    #endif
                 // Set default precision
                 if (precision == -1) precision = 6;
                 // Need one extra digit precision in E mode
                 if (fflags & FF_ECVT) ++precision;
-                fvalue = va_arg(ap, double);
+                fvalue = va_arg(*ap, double);
+    #if defined(PRINTF_CBOR) && !defined(BASIC_PRINTF_ONLY)
+                if (CBOR_CALL)
+                {
+                    cbor_float((struct cbor_out *) context, fvalue);
+                    goto conv_done;
+                }
+    #endif
+    #if FEATURE(USE_EXACT_FLOAT)
+                // Finite values in 'f' format are written out directly.
+                if (fflags == FF_FCVT && fvalue - fvalue == 0 && !STEP_CALL)
+                {
+        #ifdef PRINTF_T
+                    count +=
+        #endif
+        #if FEATURE(USE_STATS)
+                    sbytes =
+        #endif
+                    exact_fixed(FILL_ARGS, fvalue, precision, width, flags);
+                    width = 0;
+                    precision = -1;
+                    break;
+                }
+    #endif
                 p = format_float(fvalue, precision, width, flags, fflags, buffer);
                 // Precision is not used to limit number output.
                 precision = -1;
                 break;
 #endif
-#if FEATURE(USE_STRING)
-    #if FEATURE(USE_FSTRING)
-            case 'S':
-                flags |= FL_FSTR;
-                // fall through
+#if FEATURE(USE_HEX_FLOAT)
+            case CONV_CASE('A', CT_HEXF_U):
+                fflags = FF_UCASE;
+                // fall through
+            case CONV_CASE('a', CT_HEXF):
+    #if FEATURE(USE_STATS)
+                stat = PRINTF_STAT_FLOAT;
+    #endif
+                fvalue = va_arg(*ap, double);
+    #if defined(PRINTF_CBOR) && !defined(BASIC_PRINTF_ONLY)
+                if (CBOR_CALL)
+                {
+                    cbor_float((struct cbor_out *) context, fvalue);
+                    goto conv_done;
+                }
+    #endif
+    #if FEATURE(USE_SPACE_PAD) || FEATURE(USE_ZERO_PAD) || FEATURE(USE_FLOAT)
+                p = format_hex_float(fvalue, precision, width, flags, fflags, buffer);
+    #else
+                p = format_hex_float(fvalue, precision, 0, flags, fflags, buffer);
+    #endif
+    #if FEATURE(USE_PRECISION) || FEATURE(USE_FLOAT)
+                // Precision is not used to limit number output.
+                precision = -1;
+    #endif
+                break;
+#endif
+#if FEATURE(USE_STRING)
+    #if FEATURE(USE_FSTRING)
+            case CONV_CASE('S', CT_FSTR):
+                flags |= FL_FSTR;
+                // fall through
+    #endif
+            case CONV_CASE('s', CT_STR):
+    #if FEATURE(USE_STATS)
+                stat = PRINTF_STAT_STRING;
+    #endif
+                p = va_arg(*ap, char *);
+                break;
+#endif
+#if FEATURE(USE_ESCAPE)
+            case CONV_CASE('J', CT_JSON):
+            case CONV_CASE('Q', CT_CSV):
+    #if FEATURE(USE_STATS)
+                stat = PRINTF_STAT_STRING;
+    #endif
+                p = va_arg(*ap, char *);
+    #if defined(PRINTF_CBOR) && !defined(BASIC_PRINTF_ONLY)
+                // Strings need no escaping in binary output.
+                if (CBOR_CALL)
+                    break;
+    #endif
+    #if defined(PRINTF_STEP) && !defined(BASIC_PRINTF_ONLY)
+                if (STEP_CALL)
+                {
+                    // printf_step() escapes the text one sequence at a time as it is output.
+                    step = (struct printf_step *) context;
+                    step->fmt = fmt + 1;
+                    step->flags = flags;
+        #ifdef PRINTF_WCET
+                    if (precision < 0 || precision > PRINTF_WCET_CHARS) precision = PRINTF_WCET_CHARS;
+        #endif
+        #if FEATURE(USE_SPACE_PAD)
+                    step->width = width;
+                    step->pad = 0;
+                    if (width > 0 && !(flags & FL_LEFT_JUST))
+                    {
+                        fwidth = (int) escape_text(OUT_ARGS_NULL, p, convert, precision);
+                        if (fwidth < width) step->pad = width - fwidth;
+                    }
+        #endif
+                    step->prec = -1;
+                    step->src = p;
+                    step->limit = precision;
+                    step->escape = convert;
+                    // The opening quote of %Q comes first.
+                    step->buf[0] = '"';
+                    step->buf[convert == 'Q'] = '\0';
+                    step->p = step->buf;
+        #if FEATURE(USE_STATS)
+                    stats[stat].calls++;
+                    stats[stat].cycles += PRINTF_STATS_TIME() - tconv;
+        #endif
+                    goto step_done;
+                }
+    #endif
+    #ifdef PRINTF_T
+                count +=
+    #endif
+    #if FEATURE(USE_STATS)
+                sbytes =
+    #endif
+    #if FEATURE(USE_SPACE_PAD) || FEATURE(USE_ZERO_PAD) || FEATURE(USE_FLOAT)
+                put_escaped(FILL_ARGS, p, convert, precision, width, flags);
+                width = 0;
+    #else
+                put_escaped(FILL_ARGS, p, convert, precision, 0, flags);
+    #endif
+                // The text has been output, so leave nothing for the loop below.
+                p = buffer + BUFMAX;
+                break;
+#endif
+#if FEATURE(USE_TIMESTAMP)
+            case CONV_CASE('T', CT_TIME):
+                // The context comes first, followed by the time in ticks.
+                tc = va_arg(*ap, struct printf_time *);
+    #if FEATURE(USE_LONG_LONG)
+                if (fflags & FF_XLONG)
+                    ticks = va_arg(*ap, unsigned long long);
+                else
+    #endif
+                    ticks = va_arg(*ap, unsigned long);
+                // A rate of zero is not valid and is shown as ?.
+                if (tc->rate == 0)
+                    *--p = '?';
+                else
+                    p = format_time(tc, ticks / tc->rate, ticks % tc->rate, precision);
+    #if FEATURE(USE_PRECISION) || FEATURE(USE_FLOAT)
+                // Precision is not used to limit timestamp output.
+                precision = -1;
     #endif
-            case 's':
-                p = va_arg(ap, char *);
                 break;
 #endif
             default:
+#if FEATURE(USE_CUSTOM)
+                cfunc = find_custom(convert);
+                if (cfunc)
+                {
+                    spec.convert = convert;
+                    spec.flags = flags;
+    #if FEATURE(USE_LONG_LONG)
+                    // FL_NEG is only used by numbers, so its bit is free for ll.
+                    if ((fflags & (FF_XLONG | FF_X128)) == FF_XLONG)
+                        spec.flags |= PRINTF_LONG_LONG;
+    #endif
+    #if FEATURE(USE_SPACE_PAD) || FEATURE(USE_ZERO_PAD) || FEATURE(USE_FLOAT)
+                    spec.width = width;
+    #else
+                    spec.width = 0;
+    #endif
+                    spec.prec = precision;
+                    // The text is output in the same way as a string.
+                    p = (char *) cfunc(&spec, ap, buffer, BUFMAX + 1);
+    #if FEATURE(USE_PRECISION) || FEATURE(USE_FLOAT)
+                    precision = spec.prec;
+    #endif
+                    break;
+                }
+#endif
+#if defined(PRINTF_CBOR) && !defined(BASIC_PRINTF_ONLY)
+                // Not a conversion, so it is part of the literal text.
+                if (CBOR_CALL)
+                {
+                    OUT(convert);
+                    goto conv_done;
+                }
+#endif
                 *--p = convert;
                 break;
             }
 
-#if FEATURE(USE_SPACE_PAD)
-            // Check width of formatted text.
+#if defined(PRINTF_CBOR) && !defined(BASIC_PRINTF_ONLY)
+            // Other conversions are sent as the text they produce.
+            if (CBOR_CALL)
+            {
     #if FEATURE(USE_FSTRING)
-            fwidth = p_len(p, flags);
+                cbor_text((struct cbor_out *) context, p, flags, precision);
     #else
-            fwidth = p_len(p);
+                cbor_text((struct cbor_out *) context, p, 0, precision);
     #endif
-            // Copy formatted text with leading or trailing space.
-            // A positive value for precision will limit the length of p used.
-            for (;;)
+                goto conv_done;
+            }
+#endif
+
+#if defined(PRINTF_STEP) && !defined(BASIC_PRINTF_ONLY)
+            if (STEP_CALL)
             {
-    #if FEATURE(USE_FSTRING)
-                if (flags & FL_FSTR)
-                    c = GET_FORMAT(p);
-                else
+                // Leave the text and field details for printf_step() to output.
+                step = (struct printf_step *) context;
+                step->fmt = fmt + 1;
+                step->flags = flags;
+    #if FEATURE(USE_SPACE_PAD)
+                step->width = width;
+                step->pad = lead_pad(p, flags, width, precision);
     #endif
-                c = *p;
-                if ((c == '\0' || precision == 0) && width <= 0) break;
-                if (((flags & FL_LEFT_JUST) || width <= fwidth) && c && precision != 0) ++p;
-                else c = ' ';
-                // for loop continues after #endif
-#else
-            for (;;)
-            {
-    #if FEATURE(USE_FSTRING)
-                if (flags & FL_FSTR)
-                    c = GET_FORMAT(p);
+                step->prec = precision;
+    #ifdef PRINTF_WCET
+                if (step->prec < 0) step->prec = PRINTF_WCET_CHARS;
+    #endif
+                // Text in the local buffer is copied to the context.
+                if (p >= buffer && p <= buffer + BUFMAX)
+                {
+                    q = step->buf + (p - buffer);
+                    step->p = q;
+                    while ((*q++ = *p++) != '\0')
+                        ;
+                }
                 else
+                {
+                    step->p = p;
+                }
+    #if FEATURE(USE_ESCAPE)
+                step->escape = 0;
+    #endif
+    #if FEATURE(USE_STATS)
+                // The chars are output later by printf_step(), so only the conversion is counted.
+                stats[stat].calls++;
+                stats[stat].cycles += PRINTF_STATS_TIME() - tconv;
     #endif
-                c = *p;
+                goto step_done;
+            }
+#endif
+
+#if FEATURE(USE_SPACE_PAD)
+            // The text is output in one pass, with leading or trailing space.
+            // Only leading space needs the length of the text first.
+            // A positive value for precision will limit the length of p used.
+            fill_out(FILL_ARGS, ' ', lead_pad(p, flags, width, precision));
+            fwidth = (int) out_text(OUT_ARGS, p, precision, flags);
+            if (flags & FL_LEFT_JUST) fill_out(FILL_ARGS, ' ', width - fwidth);
+            if (fwidth < width) fwidth = width;
+#else
     #if FEATURE(USE_PRECISION)
-                // A positive value for precision will limit the length of p used.
-                if (c == '\0' || precision == 0) break;
+            // A positive value for precision will limit the length of p used.
+            fwidth = (int) out_text(OUT_ARGS, p, precision, flags);
     #else
-                if (c == '\0') break;
+            fwidth = (int) out_text(OUT_ARGS, p, -1, flags);
     #endif
-                ++p;
-                // for loop continues after #endif
 #endif
-                // for loop continues here from either of the USE_SPACE_PAD cases.
-#ifdef BASIC_PRINTF_ONLY
-                func(c);            // Basic output function.
+#ifdef PRINTF_T
+            count += fwidth;
+#endif
+#if FEATURE(USE_STATS)
+            sbytes += fwidth;
+#endif
+#if defined(PRINTF_CBOR) && !defined(BASIC_PRINTF_ONLY)
+        conv_done: ;
+#endif
+#if FEATURE(USE_STATS)
+            stats[stat].calls++;
+            stats[stat].bytes += sbytes;
+            stats[stat].cycles += PRINTF_STATS_TIME() - tconv;
+            stats[PRINTF_STAT_CALL].bytes += sbytes;
+#endif
+        }
+        else
+        {
+#ifdef BASIC_PRINTF_ONLY
+            func(convert);              // Basic output function.
+#else
+            func(convert, context);     // Output function.
+#endif
+#ifdef PRINTF_T
+            ++count;
+#endif
+#if FEATURE(USE_STATS)
+            stats[PRINTF_STAT_CALL].bytes++;
+#endif
+        }
+        ++fmt;
+    }
+#if FEATURE(USE_STATS)
+    stats[PRINTF_STAT_CALL].calls++;
+    stats[PRINTF_STAT_CALL].cycles += PRINTF_STATS_TIME() - tcall;
+#endif
+#if defined(PRINTF_STEP) && !defined(BASIC_PRINTF_ONLY)
+step_done: ;
+#endif
+
+#ifdef PRINTF_T
+    return count;
+#endif
+}
+
+/* ---------------------------------------------------------------------------
+Function: putout()
+This is the output function used for printf.
+The context is normally required, but is not used at present. It could be
+extended to include streams or to avoid output mixing in multi-threaded use.
+If using BASIC_PRINTF, context is not supported.
+--------------------------------------------------------------------------- */
+#ifdef BASIC_PRINTF_ONLY
+static void putout(char c)
+{
+#else
+static void putout(char c, void *context)
+{
+    (void) context;     // Suppress compiler warning about unused argument.
+#endif
+    PUTCHAR_FUNC(c);
+}
+
+#if defined(PUTFILL_FUNC) && !defined(BASIC_PRINTF_ONLY)
+/* ---------------------------------------------------------------------------
+Function: fillout()
+This is the fill function used for printf, which outputs n copies of c.
+--------------------------------------------------------------------------- */
+static void fillout(char c, width_t n, void *context)
+{
+    (void) context;
+    PUTFILL_FUNC(c, n);
+}
+#endif
+
+#ifdef PRINTF_LOG
+// Levels turned off for each module, used by printf_log() in printf.h.
+unsigned char printf_log_mute[PRINTF_LOG_MODULES];
+#endif
+
+/* ---------------------------------------------------------------------------
+Function: printf()
+Replacement for library printf - writes to output (normally serial)
+It uses the output function putout() to update the serial output.
+If PRINTF_T is defined then the number of characters generated is returned.
+--------------------------------------------------------------------------- */
+printf_t printf(const char *fmt, ...)
+{
+    va_list ap;
+#ifdef PRINTF_T
+    int Count;
+#endif
+
+    va_start(ap, fmt);
+#ifdef PRINTF_T
+  #ifdef BASIC_PRINTF_ONLY
+    Count = doprnt(putout, fmt, &ap);
+  #else
+    Count = doprnt((void *)0, putout, PUTFILL, fmt, &ap);
+  #endif
+#else
+  #ifdef BASIC_PRINTF_ONLY
+    doprnt(putout, fmt, &ap);
+  #else
+    doprnt((void *)0, putout, PUTFILL, fmt, &ap);
+  #endif
+#endif
+    va_end(ap);
+    
+#ifdef PRINTF_T
+    return Count;
+#endif
+}
+
+#ifndef BASIC_PRINTF_ONLY
+/* ---------------------------------------------------------------------------
+Function: putbuf()
+This is the output function used for sprintf.
+Here the context is a pointer to a pointer to the buffer.
+Double indirection allows the function to increment the buffer pointer.
+--------------------------------------------------------------------------- */
+static void putbuf(char c, void *context)
+{
+    char *buf = *((char **) context);
+    *buf++ = c;
+    *((char **) context) = buf;
+}
+
+/* ---------------------------------------------------------------------------
+Function: fillbuf()
+This is the fill function used for sprintf, with the same context as putbuf.
+--------------------------------------------------------------------------- */
+static void fillbuf(char c, width_t n, void *context)
+{
+    char *buf = *((char **) context);
+    do
+        *buf++ = c;
+    while (--n);
+    *((char **) context) = buf;
+}
+
+/* ---------------------------------------------------------------------------
+Function: sprintf()
+Replacement for library sprintf - writes into buffer supplied.
+Normally it uses the output function putout() to update the buffer.
+sprintf is not supported when using BASIC_PRINTF
+If PRINTF_T is defined then the number of characters generated is returned.
+--------------------------------------------------------------------------- */
+printf_t sprintf(char *buf, const char *fmt, ... )
+{
+    va_list ap;
+#ifdef PRINTF_T
+    int Count;
+#endif
+
+    va_start(ap, fmt);
+#ifdef PRINTF_T
+    Count = doprnt(&buf, putbuf, fillbuf, fmt, &ap);
+#else
+    doprnt(&buf, putbuf, fillbuf, fmt, &ap);
+#endif
+    va_end(ap);
+    // Append null terminator.
+    *buf = '\0';
+    
+#ifdef PRINTF_T
+    return Count;
+#endif
+}
+#endif
+
+#if defined(PRINTF_DMA) && !defined(BASIC_PRINTF_ONLY)
+/*****************************************************************************
+Double-buffered DMA output
+
+One buffer is filled by printf while the other is being sent. The fill
+buffer is handed to the start function when it is full or at the end of
+a call if no transfer is in progress. printf_dma_done() is called when
+a transfer completes, normally from the DMA interrupt, and starts the
+next one if text is waiting and printf is not running at the time.
+The active and busy flags make this safe without disabling interrupts,
+provided only one thread calls printf_dma() for a given channel.
+******************************************************************************/
+
+/* ---------------------------------------------------------------------------
+Function: dma_start()
+Hand the fill buffer to the start function and swap to the other one.
+The buffer state is updated first in case the transfer completes at once.
+--------------------------------------------------------------------------- */
+static void dma_start(struct printf_dma *dma)
+{
+    const char *data = dma->buf[dma->fill];
+    unsigned len = dma->len;
+
+    dma->busy = 1;
+    dma->fill ^= 1;
+    dma->len = 0;
+    dma->start(data, len, dma->user);
+}
+
+/* ---------------------------------------------------------------------------
+Function: putdma()
+This is the output function used for printf_dma.
+The context is the DMA channel. When the fill buffer is full it waits
+for the previous transfer to complete before starting the next one.
+--------------------------------------------------------------------------- */
+static void putdma(char c, void *context)
+{
+    struct printf_dma *dma = (struct printf_dma *) context;
+
+    if (dma->len == dma->size)
+    {
+        while (dma->busy)
+        {
+            if (dma->wait) dma->wait(dma->user);
+        }
+        dma_start(dma);
+    }
+    dma->buf[dma->fill][dma->len++] = c;
+}
+
+/* ---------------------------------------------------------------------------
+Function: printf_dma_init()
+Set up a DMA channel with two buffers of the given size.
+The start function must begin sending the data given and return at once.
+The wait function, which may be null, is called repeatedly while printf
+waits for a transfer to complete, e.g. to sleep until the next interrupt.
+--------------------------------------------------------------------------- */
+void printf_dma_init(struct printf_dma *dma, char *buf0, char *buf1, unsigned size,
+                     printf_dma_start_t start, void (*wait)(void *user), void *user)
+{
+    dma->buf[0] = buf0;
+    dma->buf[1] = buf1;
+    dma->size = size;
+    dma->len = 0;
+    dma->fill = 0;
+    dma->busy = 0;
+    dma->active = 0;
+    dma->start = start;
+    dma->wait = wait;
+    dma->user = user;
+}
+
+/* ---------------------------------------------------------------------------
+Function: printf_dma_done()
+Called when a transfer has completed. If printf is not running, any
+text waiting in the fill buffer is started now, otherwise printf will
+start it when it needs the buffer or when it returns.
+--------------------------------------------------------------------------- */
+void printf_dma_done(struct printf_dma *dma)
+{
+    dma->busy = 0;
+    if (!dma->active && dma->len)
+        dma_start(dma);
+}
+
+/* ---------------------------------------------------------------------------
+Function: printf_dma_flush()
+Wait until all text has been sent.
+--------------------------------------------------------------------------- */
+void printf_dma_flush(struct printf_dma *dma)
+{
+    while (dma->busy || dma->len)
+    {
+        if (!dma->busy)
+            dma_start(dma);
+        else if (dma->wait)
+            dma->wait(dma->user);
+    }
+}
+
+/* ---------------------------------------------------------------------------
+Function: printf_dma()
+printf to a DMA channel. The text is sent in the background, so it may
+still be in progress when this returns.
+If PRINTF_T is defined then the number of characters generated is returned.
+--------------------------------------------------------------------------- */
+printf_t printf_dma(struct printf_dma *dma, const char *fmt, ...)
+{
+    va_list ap;
+#ifdef PRINTF_T
+    int Count;
+#endif
+
+    dma->active = 1;
+    va_start(ap, fmt);
+#ifdef PRINTF_T
+    Count = doprnt(dma, putdma, 0, fmt, &ap);
+#else
+    doprnt(dma, putdma, 0, fmt, &ap);
+#endif
+    va_end(ap);
+    dma->active = 0;
+    // A transfer which completed while printf was running did not start the next one.
+    if (!dma->busy && dma->len)
+        dma_start(dma);
+
+#ifdef PRINTF_T
+    return Count;
+#endif
+}
+#endif
+
+#if defined(PRINTF_CHAIN) && !defined(BASIC_PRINTF_ONLY)
+/*****************************************************************************
+Buffer chain output
+******************************************************************************/
+
+/* ---------------------------------------------------------------------------
+Function: putchain()
+This is the output function used for printf_chain.
+The context points to the current fragment, which is advanced past any
+which are full. Chars are dropped once the end of the chain is reached.
+--------------------------------------------------------------------------- */
+static void putchain(char c, void *context)
+{
+    struct printf_frag **frag = (struct printf_frag **) context;
+
+    while (*frag && (*frag)->len >= (*frag)->size)
+        *frag = (*frag)->next;
+    if (*frag)
+        (*frag)->data[(*frag)->len++] = c;
+}
+
+/* ---------------------------------------------------------------------------
+Function: printf_chain()
+printf into a chain of buffer fragments, after any text already there.
+If PRINTF_T is defined then the number of characters generated is returned.
+--------------------------------------------------------------------------- */
+printf_t printf_chain(struct printf_frag *chain, const char *fmt, ...)
+{
+    va_list ap;
+#ifdef PRINTF_T
+    int Count;
+#endif
+
+    va_start(ap, fmt);
+#ifdef PRINTF_T
+    Count = doprnt(&chain, putchain, 0, fmt, &ap);
 #else
-                func(c, context);   // Output function.
+    doprnt(&chain, putchain, 0, fmt, &ap);
 #endif
+    va_end(ap);
+
 #ifdef PRINTF_T
-                ++count;
-#endif
-#if FEATURE(USE_SPACE_PAD)
-                --width;
+    return Count;
 #endif
-#if FEATURE(USE_PRECISION)
-                if (precision > 0) --precision;
+}
 #endif
+
+#if defined(PRINTF_MMAP) && !defined(BASIC_PRINTF_ONLY)
+/*****************************************************************************
+Memory-mapped log file
+
+Threads reserve space with an atomic add on the head offset, so the only
+shared write in the normal case is that one instruction. The file must
+cover a record before it is written, or the access would fault, so a
+writer which passes the end of the file grows it by whole extents while
+holding the growing flag. Other writers which need the new space wait
+until the size has been updated.
+******************************************************************************/
+
+/* ---------------------------------------------------------------------------
+Function: mmap_grow()
+Make sure the file covers the given end offset.
+Returns 0 if it does, or -1 if the file could not be grown.
+--------------------------------------------------------------------------- */
+static int mmap_grow(struct printf_mmap *log, unsigned long end)
+{
+    unsigned long size;
+
+    while (__atomic_load_n(&log->size, __ATOMIC_ACQUIRE) < end)
+    {
+        if (__atomic_test_and_set(&log->growing, __ATOMIC_ACQUIRE))
+            continue;
+        size = log->size;
+        if (size < end)
+        {
+            size = (end + log->extent - 1) / log->extent * log->extent;
+            if (size > log->limit)
+                size = log->limit;
+            if (ftruncate(log->fd, (off_t) size) != 0)
+            {
+                __atomic_clear(&log->growing, __ATOMIC_RELEASE);
+                return -1;
             }
+            __atomic_store_n(&log->size, size, __ATOMIC_RELEASE);
         }
-        else
-        {
-#ifdef BASIC_PRINTF_ONLY
-            func(convert);              // Basic output function.
-#else
-            func(convert, context);     // Output function.
+        __atomic_clear(&log->growing, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+/* ---------------------------------------------------------------------------
+Function: printf_mmap_open()
+Open or create a log file and map limit bytes of it. New records are added
+after any already in the file, which grows extent bytes at a time.
+Returns 0 if successful or -1 if the file could not be opened or mapped.
+--------------------------------------------------------------------------- */
+int printf_mmap_open(struct printf_mmap *log, const char *path,
+                     unsigned long limit, unsigned long extent)
+{
+    struct stat st;
+    void *map;
+
+    log->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (log->fd < 0)
+        return -1;
+    if (fstat(log->fd, &st) != 0 || (unsigned long) st.st_size > limit)
+        goto fail;
+    map = mmap(0, limit, PROT_READ | PROT_WRITE, MAP_SHARED, log->fd, 0);
+    if (map == MAP_FAILED)
+        goto fail;
+    log->map = (char *) map;
+    log->head = (unsigned long) st.st_size;
+    log->end = (unsigned long) st.st_size;
+    log->size = (unsigned long) st.st_size;
+    log->limit = limit;
+    log->extent = extent ? extent : 1;
+    log->dropped = 0;
+    log->growing = 0;
+    return 0;
+
+fail:
+    close(log->fd);
+    log->fd = -1;
+    return -1;
+}
+
+/* ---------------------------------------------------------------------------
+Function: printf_mmap_close()
+Unmap the log and cut the file back to the end of the last record.
+The head also counts the space of dropped records, so it is not used.
+No other thread may be writing to the log.
+Returns 0 if successful or -1 if the file could not be cut back.
+--------------------------------------------------------------------------- */
+int printf_mmap_close(struct printf_mmap *log)
+{
+    int ret;
+
+    munmap(log->map, log->limit);
+    ret = ftruncate(log->fd, (off_t) log->end);
+    close(log->fd);
+    log->fd = -1;
+    return ret ? -1 : 0;
+}
+
+/* ---------------------------------------------------------------------------
+Function: putline()
+This is the output function used for printf_mmap.
+The context holds the next position and the end of the line buffer.
+Chars past the end are dropped.
+--------------------------------------------------------------------------- */
+static void putline(char c, void *context)
+{
+    char **line = (char **) context;
+
+    if (line[0] < line[1])
+        *line[0]++ = c;
+}
+
+/* ---------------------------------------------------------------------------
+Function: printf_mmap()
+printf one record to the log. It is formatted on the stack and then
+copied to the space reserved for it.
+If PRINTF_T is defined then the number of characters generated is returned.
+--------------------------------------------------------------------------- */
+printf_t printf_mmap(struct printf_mmap *log, const char *fmt, ...)
+{
+    char buf[PRINTF_MMAP_LINE];
+    char *line[2];
+    unsigned long len, off, end;
+    va_list ap;
+#ifdef PRINTF_T
+    int Count;
 #endif
+
+    line[0] = buf;
+    line[1] = buf + sizeof(buf);
+    va_start(ap, fmt);
 #ifdef PRINTF_T
-            ++count;
+    Count = doprnt(line, putline, 0, fmt, &ap);
+#else
+    doprnt(line, putline, 0, fmt, &ap);
 #endif
-        }
-        ++fmt;
+    va_end(ap);
+
+    len = (unsigned long) (line[0] - buf);
+    off = __atomic_fetch_add(&log->head, len, __ATOMIC_RELAXED);
+    if (off + len > log->limit || mmap_grow(log, off + len) != 0)
+        __atomic_fetch_add(&log->dropped, 1UL, __ATOMIC_RELAXED);
+    else
+    {
+        memcpy(log->map + off, buf, len);
+        // Move the end of the written records on, unless a later one is already done.
+        end = __atomic_load_n(&log->end, __ATOMIC_RELAXED);
+        while (end < off + len &&
+               !__atomic_compare_exchange_n(&log->end, &end, off + len, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            ;
     }
 
 #ifdef PRINTF_T
-    return count;
+    return Count;
 #endif
 }
+#endif
+
+#if defined(PRINTF_SHARD) && !defined(BASIC_PRINTF_ONLY)
+/*****************************************************************************
+Sharded log buffers
+
+Each shard is a ring with one writer and one reader. The writer only sets
+head and the drain only sets tail, so neither needs a lock. One byte is
+always left free so that head == tail means empty. A record is a header
+of the time stamp and the length, each stored low byte first, followed by
+the text. The header is filled in once the text is complete, and head is
+only moved past the record after that.
+******************************************************************************/
+
+#define SHARD_HEADER    (sizeof(unsigned long) + 2)
 
 /* ---------------------------------------------------------------------------
-Function: putout()
-This is the output function used for printf.
-The context is normally required, but is not used at present. It could be
-extended to include streams or to avoid output mixing in multi-threaded use.
-If using BASIC_PRINTF, context is not supported.
+Function: shard_put()
+Write a char at the writer's position, unless the ring is full.
 --------------------------------------------------------------------------- */
-#ifdef BASIC_PRINTF_ONLY
-static void putout(char c)
+static void shard_put(struct printf_shard *shard, char c)
 {
-#else
-static void putout(char c, void *context)
+    unsigned next = shard->pos + 1;
+
+    if (next == shard->size)
+        next = 0;
+    if (next == shard->tail)
+        shard->full = 1;
+    if (shard->full)
+        return;
+    shard->buf[shard->pos] = c;
+    shard->pos = next;
+}
+
+/* ---------------------------------------------------------------------------
+Function: putshard()
+This is the output function used for printf_shard.
+The context is the shard.
+--------------------------------------------------------------------------- */
+static void putshard(char c, void *context)
 {
-    (void) context;     // Suppress compiler warning about unused argument.
-#endif
-    PUTCHAR_FUNC(c);
+    shard_put((struct printf_shard *) context, c);
 }
 
 /* ---------------------------------------------------------------------------
-Function: printf()
-Replacement for library printf - writes to output (normally serial)
-It uses the output function putout() to update the serial output.
+Function: shard_get()
+Read the char at the given position in the ring and move it on.
+--------------------------------------------------------------------------- */
+static unsigned char shard_get(const struct printf_shard *shard, unsigned *pos)
+{
+    unsigned char c = (unsigned char) shard->buf[*pos];
+
+    if (++*pos == shard->size)
+        *pos = 0;
+    return c;
+}
+
+/* ---------------------------------------------------------------------------
+Function: printf_shard_init()
+Set up a shard with the buffer given.
+--------------------------------------------------------------------------- */
+void printf_shard_init(struct printf_shard *shard, char *buf, unsigned size)
+{
+    shard->buf = buf;
+    shard->size = size;
+    shard->head = 0;
+    shard->tail = 0;
+    shard->pos = 0;
+    shard->full = 0;
+    shard->dropped = 0;
+}
+
+/* ---------------------------------------------------------------------------
+Function: printf_shard()
+printf one record to a shard. Only one core or thread may write to each
+shard, but it may do so while another drains it.
 If PRINTF_T is defined then the number of characters generated is returned.
 --------------------------------------------------------------------------- */
-printf_t printf(const char *fmt, ...)
+printf_t printf_shard(struct printf_shard *shard, const char *fmt, ...)
 {
+    unsigned long stamp = PRINTF_SHARD_TIME();
+    unsigned start = shard->head;
+    unsigned len;
+    unsigned char i;
     va_list ap;
 #ifdef PRINTF_T
     int Count;
 #endif
 
+    // Leave space for the header, then format the text after it.
+    shard->full = 0;
+    shard->pos = start;
+    for (i = 0; i < SHARD_HEADER; i++)
+        shard_put(shard, 0);
+    len = shard->pos;
+
     va_start(ap, fmt);
 #ifdef PRINTF_T
-  #ifdef BASIC_PRINTF_ONLY
-    Count = doprnt(putout, fmt, ap);
-  #else
-    Count = doprnt((void *)0, putout, fmt, ap);
-  #endif
+    Count = doprnt(shard, putshard, 0, fmt, &ap);
 #else
-  #ifdef BASIC_PRINTF_ONLY
-    doprnt(putout, fmt, ap);
-  #else
-    doprnt((void *)0, putout, fmt, ap);
-  #endif
+    doprnt(shard, putshard, 0, fmt, &ap);
 #endif
     va_end(ap);
-    
+
+    len = (shard->pos + shard->size - len) % shard->size;
+    if (shard->full || len > 0xffff)
+    {
+        shard->dropped++;
+    }
+    else
+    {
+        unsigned end = shard->pos;
+
+        // Fill in the header now that the length is known.
+        shard->pos = start;
+        for (i = 0; i < sizeof(unsigned long); i++)
+            shard_put(shard, (char) (stamp >> (8 * i)));
+        shard_put(shard, (char) len);
+        shard_put(shard, (char) (len >> 8));
+        PRINTF_SHARD_BARRIER();
+        shard->head = end;
+    }
+
 #ifdef PRINTF_T
     return Count;
 #endif
 }
 
-#ifndef BASIC_PRINTF_ONLY
 /* ---------------------------------------------------------------------------
-Function: putbuf()
-This is the output function used for sprintf.
-Here the context is a pointer to a pointer to the buffer.
-Double indirection allows the function to increment the buffer pointer.
+Function: printf_shard_drain()
+Send up to max records from an array of shards to the output function,
+or all those waiting if max is zero, oldest time stamp first.
+Returns the number of records sent.
 --------------------------------------------------------------------------- */
-static void putbuf(char c, void *context)
+unsigned printf_shard_drain(struct printf_shard *shards, unsigned count,
+                            unsigned max, void (*put)(char c))
 {
-    char *buf = *((char **) context);
-    *buf++ = c;
-    *((char **) context) = buf;
+    struct printf_shard *shard, *first;
+    unsigned long stamp, first_stamp = 0;
+    unsigned sent = 0;
+    unsigned pos, len;
+    unsigned char i;
+
+    while (max == 0 || sent < max)
+    {
+        // Find the shard whose oldest record has the earliest time stamp.
+        first = 0;
+        for (shard = shards; shard < shards + count; shard++)
+        {
+            if (shard->head == shard->tail)
+                continue;
+            PRINTF_SHARD_BARRIER();
+            pos = shard->tail;
+            stamp = 0;
+            for (i = 0; i < sizeof(unsigned long); i++)
+                stamp |= (unsigned long) shard_get(shard, &pos) << (8 * i);
+            // Compare using the difference so the counter may wrap.
+            if (!first || (long) (stamp - first_stamp) < 0)
+            {
+                first = shard;
+                first_stamp = stamp;
+            }
+        }
+        if (!first)
+            break;
+
+        pos = first->tail + sizeof(unsigned long);
+        if (pos >= first->size)
+            pos -= first->size;
+        len = shard_get(first, &pos);
+        len |= (unsigned) shard_get(first, &pos) << 8;
+        while (len--)
+            put((char) shard_get(first, &pos));
+        PRINTF_SHARD_BARRIER();
+        first->tail = pos;
+        sent++;
+    }
+    return sent;
 }
+#endif
 
+#if defined(PRINTF_CBOR) && !defined(BASIC_PRINTF_ONLY)
 /* ---------------------------------------------------------------------------
-Function: sprintf()
-Replacement for library sprintf - writes into buffer supplied.
-Normally it uses the output function putout() to update the buffer.
-sprintf is not supported when using BASIC_PRINTF
+Function: printf_cbor()
+Encode the arguments as a CBOR map in buf, which holds size bytes.
+Returns the number of bytes needed, which may be more than size.
+--------------------------------------------------------------------------- */
+unsigned printf_cbor(unsigned char *buf, unsigned size, const char *fmt, ...)
+{
+    struct cbor_out cb;
+    va_list ap;
+
+    cb.buf = buf;
+    cb.size = size;
+    cb.len = 0;
+    cb.index = 0;
+    cb.klen = 0;
+    cbor_byte(&cb, 0xbf);       // Map of indefinite length
+    va_start(ap, fmt);
+    doprnt(&cb, putcbor, 0, fmt, &ap);
+    va_end(ap);
+    cbor_byte(&cb, 0xff);       // End of the map
+    return cb.len;
+}
+#endif
+
+#if defined(PRINTF_TEE) && !defined(BASIC_PRINTF_ONLY)
+/*****************************************************************************
+Output to several sinks
+******************************************************************************/
+
+/* ---------------------------------------------------------------------------
+Function: puttee()
+This is the output function used for printf_tee.
+The context is a copy of the tee with the enable mask for this call.
+--------------------------------------------------------------------------- */
+static void puttee(char c, void *context)
+{
+    struct printf_tee *tee = (struct printf_tee *) context;
+    const struct printf_sink *sink = tee->sinks;
+    unsigned enable;
+
+    for (enable = tee->enable; enable; enable >>= 1, ++sink)
+    {
+        if (enable & 1)
+            sink->put(c, sink->context);
+    }
+}
+
+/* ---------------------------------------------------------------------------
+Function: filltee()
+This is the fill function used for printf_tee, with the same context as
+puttee. Each sink gets the run in one call if it has a fill function.
+--------------------------------------------------------------------------- */
+static void filltee(char c, width_t n, void *context)
+{
+    struct printf_tee *tee = (struct printf_tee *) context;
+    const struct printf_sink *sink = tee->sinks;
+    unsigned enable;
+    width_t i;
+
+    for (enable = tee->enable; enable; enable >>= 1, ++sink)
+    {
+        if (!(enable & 1))
+            continue;
+        if (sink->fill)
+        {
+            sink->fill(c, n, sink->context);
+        }
+        else
+        {
+            for (i = 0; i < n; i++)
+                sink->put(c, sink->context);
+        }
+    }
+}
+
+/* ---------------------------------------------------------------------------
+Function: printf_tee()
+printf to each of the enabled sinks, formatting only once.
 If PRINTF_T is defined then the number of characters generated is returned.
 --------------------------------------------------------------------------- */
-printf_t sprintf(char *buf, const char *fmt, ... )
+printf_t printf_tee(struct printf_tee *tee, const char *fmt, ...)
 {
+    struct printf_tee run;
     va_list ap;
 #ifdef PRINTF_T
     int Count;
 #endif
 
+    // Use the mask as it is now for the whole call, limited to the sinks in the list.
+    run.sinks = tee->sinks;
+    run.count = tee->count;
+    run.enable = tee->enable;
+    if (run.count < sizeof(unsigned) * 8)
+        run.enable &= (1U << run.count) - 1;
     va_start(ap, fmt);
 #ifdef PRINTF_T
-    Count = doprnt(&buf, putbuf, fmt, ap);
+    Count = doprnt(&run, puttee, filltee, fmt, &ap);
 #else
-    doprnt(&buf, putbuf, fmt, ap);
+    doprnt(&run, puttee, filltee, fmt, &ap);
 #endif
     va_end(ap);
-    // Append null terminator.
-    *buf = '\0';
-    
+
 #ifdef PRINTF_T
     return Count;
 #endif
 }
 #endif
+
+#if defined(PRINTF_STEP) && !defined(BASIC_PRINTF_ONLY)
+/*****************************************************************************
+Resumable formatting
+
+printf_step() outputs as much as fits in the space given and returns, so
+output can be interleaved with other work. Literal text is copied from the
+format directly. Each conversion is done in one go by doprnt(), which leaves
+the text and field details in the step context, and is then output as space
+allows using the same padding rules as doprnt().
+******************************************************************************/
+
+#if BUFMAX >= PRINTF_STEP_BUF
+    #error PRINTF_STEP_BUF in printf.h is too small for the features selected
+#endif
+
+/* ---------------------------------------------------------------------------
+Function: printf_step_init()
+Set up a step context for the format and argument list given.
+The argument list belongs to the caller and must remain valid, and must not
+be used elsewhere, until the output is complete.
+--------------------------------------------------------------------------- */
+void printf_step_init(struct printf_step *step, const char *fmt, va_list *ap)
+{
+    step->fmt = fmt;
+    step->ap = ap;
+    step->p = 0;
+    step->escape = 0;
+}
+
+#if FEATURE(USE_ESCAPE)
+/* ---------------------------------------------------------------------------
+Function: step_escape()
+Put the next escape sequence of a %J or %Q string in the step buffer. At the
+end of the string or the precision, the closing quote of %Q is put there
+instead and escaping stops.
+--------------------------------------------------------------------------- */
+static void step_escape(struct printf_step *step)
+{
+    unsigned char n = 0;
+
+    if (*step->src != '\0')
+        n = escape_seq(*step->src, step->escape, step->buf);
+    if (n != 0 && (step->limit < 0 || n <= step->limit))
+    {
+        ++step->src;
+        if (step->limit > 0) step->limit -= n;
+    }
+    else
+    {
+        n = 0;
+        if (step->escape == 'Q') step->buf[n++] = '"';
+        step->escape = 0;
+    }
+    step->buf[n] = '\0';
+    step->p = step->buf;
+}
+#endif
+
+/* ---------------------------------------------------------------------------
+Function: printf_step()
+Write up to space chars of output. Returns the number written, which is
+less than space once the output is complete.
+Exact %f output with USE_EXACT_FLOAT is not resumable, so %f uses the
+normal floating point conversion here.
+--------------------------------------------------------------------------- */
+int printf_step(struct printf_step *step, char *out, int space)
+{
+    int n = 0;
+    char c;
+
+    while (n < space)
+    {
+        if (step->p == 0)
+        {
+            c = GET_FORMAT(step->fmt);
+            if (c == '\0') break;
+            if (c == '%')
+            {
+                // Convert the next argument ready for output.
+                doprnt(step, 0, 0, step->fmt, step->ap);
+                continue;
+            }
+            ++step->fmt;
+        }
+        else
+        {
+#if FEATURE(USE_ESCAPE)
+            if (step->escape && *step->p == '\0')
+                step_escape(step);
+#endif
+#if FEATURE(USE_FSTRING)
+            if (step->flags & FL_FSTR)
+                c = GET_FORMAT(step->p);
+            else
+#endif
+            c = *step->p;
+#if FEATURE(USE_SPACE_PAD)
+            // Leading spaces, then the text, then trailing spaces to fill the width.
+            if (step->pad > 0)
+            {
+                c = ' ';
+                --step->pad;
+            }
+            else if (c != '\0' && step->prec != 0)
+            {
+                ++step->p;
+                if (step->prec > 0) --step->prec;
+            }
+            else if (step->width > 0)
+            {
+                c = ' ';
+            }
+            else
+            {
+                step->p = 0;
+                continue;
+            }
+            --step->width;
+#else
+            if (c == '\0' || step->prec == 0)
+            {
+                step->p = 0;
+                continue;
+            }
+            ++step->p;
+            if (step->prec > 0) --step->prec;
+#endif
+        }
+        out[n++] = c;
+    }
+    return n;
+}
+#endif
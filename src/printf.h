@@ -30,6 +30,8 @@ DEALINGS IN THE SOFTWARE.
 #ifndef PRINTF_H
 #define PRINTF_H
 
+#include <stdarg.h>
+
 /*************************************************************************
 Number of chars output
 
@@ -84,4 +86,364 @@ extern printf_t printf(const char *, ...);
 extern printf_t sprintf(char *, const char *, ...);
 #endif
 
+/*************************************************************************
+Custom conversions (USE_CUSTOM)
+
+A function can be registered to handle a conversion letter which is not
+built in. It is passed the parsed specifier, a pointer to the argument list
+from which it must take its own arguments, and a buffer of the given size.
+The buffer is the one used to format numbers, so it adds nothing to the
+stack, but it holds only BUFMAX + 1 chars, at least 17. Longer text must be
+held elsewhere, e.g. in a static buffer or one passed as an argument.
+It returns a pointer to the null terminated text, either written into the
+buffer or held elsewhere. The text is then padded and justified in the same
+way as a %s string. The precision in spec->prec limits the length of the
+text unless the function sets it to -1.
+
+printf_register() returns 0 on success, or -1 if the table is full or the
+letter cannot be used: the built-in conversions with the features selected,
+'%', and the flag, width, precision and length chars.
+*************************************************************************/
+
+// Bits in the flags member of printf_spec
+#define PRINTF_LEFT_JUST    (1<<0)
+#define PRINTF_ZERO_PAD     (1<<1)
+#define PRINTF_SPECIAL      (1<<2)
+#define PRINTF_PLUS         (1<<3)
+#define PRINTF_SPACE        (1<<4)
+#define PRINTF_LONG_LONG    (1<<5)
+#define PRINTF_LONG         (1<<6)
+
+struct printf_spec
+{
+    char convert;           // Conversion letter
+    unsigned char flags;    // PRINTF_ flag bits
+    int width;              // Field width, 0 if not given
+    int prec;               // Precision, -1 if not given
+};
+
+typedef const char *(*printf_conv_t)(struct printf_spec *spec, va_list *ap, char *buf, int size);
+
+extern int printf_register(char convert, printf_conv_t func);
+
+/*************************************************************************
+Timestamp conversion (USE_TIMESTAMP)
+
+%T takes a pointer to a struct printf_time followed by an unsigned long
+time in ticks since 1970-01-01 (unsigned long long with %llT) and prints
+it as YYYY-MM-DDTHH:MM:SS. The precision gives the number of digits after
+the seconds, e.g. %.3T for milliseconds.
+
+Set rate to the number of ticks per second and clear the text before first
+use. Any rate up to ULONG_MAX is handled, and a rate of 0 prints "?". The struct caches the last date and time, so give each thread or log
+stream its own.
+*************************************************************************/
+
+struct printf_time
+{
+    unsigned long rate;     // Ticks per second
+    unsigned long secs;     // Second of the cached text
+    unsigned long day;      // Day of the cached text
+    char text[30];          // Cached text, empty if not yet valid
+};
+
+/*************************************************************************
+Execution steps (PRINTF_WCET)
+
+With PRINTF_WCET defined in printf_cfg.h, printf_wcet_steps counts the
+chars output by conversions and the steps taken to normalise floating
+point numbers. Every other loop is bounded by one of these or by the size
+of the number buffer. Clear it before a call and read it after to check
+the bounds given in the documentation for each conversion.
+*************************************************************************/
+
+extern unsigned long printf_wcet_steps;
+
+/*************************************************************************
+Instrumentation (USE_STATS)
+
+Counts are kept for each type of conversion. Each entry records the number
+of conversions, the bytes they output and the time they took, measured by
+PRINTF_STATS_TIME() in printf_cfg.h. The PRINTF_STAT_CALL entry covers the
+whole printf or sprintf call, so the cost of the literal text is the
+difference between it and the sum of the others.
+
+printf_stats_snapshot() copies PRINTF_STAT_MAX entries into the array
+given and printf_stats_reset() clears them.
+*************************************************************************/
+
+#define PRINTF_STAT_CALL    0   // Whole printf calls
+#define PRINTF_STAT_CHAR    1   // %c
+#define PRINTF_STAT_STRING  2   // %s and %S
+#define PRINTF_STAT_INT     3   // %d %i %u %o %b %x %X
+#define PRINTF_STAT_FLOAT   4   // %f %e %g %a and upper case versions
+#define PRINTF_STAT_OTHER   5   // %T, custom conversions and anything else
+#define PRINTF_STAT_MAX     6
+
+struct printf_stat
+{
+    unsigned long calls;    // Number of calls or conversions
+    unsigned long bytes;    // Number of chars output
+    unsigned long cycles;   // Total of PRINTF_STATS_TIME() differences
+};
+
+extern void printf_stats_snapshot(struct printf_stat *snap);
+extern void printf_stats_reset(void);
+
+/*************************************************************************
+Double-buffered DMA output (PRINTF_DMA)
+
+printf_dma() formats into one of two buffers while the other is sent
+by DMA. The start function is given each full buffer, or the text so far
+at the end of a call, and must start the transfer and return at once.
+Call printf_dma_done() when the transfer completes, e.g. from the DMA
+interrupt. printf only waits if both buffers are in use, calling the
+wait function if given. printf_dma_flush() waits until all is sent.
+Only one thread may use a channel.
+*************************************************************************/
+
+typedef void (*printf_dma_start_t)(const char *data, unsigned len, void *user);
+
+struct printf_dma
+{
+    char *buf[2];                   // The two buffers
+    unsigned size;                  // Size of each buffer
+    volatile unsigned len;          // Chars in the fill buffer
+    volatile unsigned char fill;    // Index of the fill buffer
+    volatile unsigned char busy;    // A transfer is in progress
+    volatile unsigned char active;  // printf is writing to the fill buffer
+    printf_dma_start_t start;       // Start a transfer
+    void (*wait)(void *user);       // Called while waiting, may be null
+    void *user;                     // Passed to start and wait
+};
+
+extern void printf_dma_init(struct printf_dma *dma, char *buf0, char *buf1, unsigned size,
+                            printf_dma_start_t start, void (*wait)(void *user), void *user);
+extern printf_t printf_dma(struct printf_dma *dma, const char *fmt, ...);
+extern void printf_dma_done(struct printf_dma *dma);
+extern void printf_dma_flush(struct printf_dma *dma);
+
+/*************************************************************************
+Buffer chain output (PRINTF_CHAIN)
+
+printf_chain() writes directly into a chain of fragments such as network
+buffers, moving to the next fragment whenever one is full, including in
+the middle of a number. Output is appended after the len chars already in
+each fragment, so clear len before the first call for a new message. On
+return len holds the number of chars in each fragment. Output which does
+not fit in the chain is discarded, but is still included in the count
+returned. An iovec array can be used by linking one fragment to each
+entry. No null terminator is written.
+*************************************************************************/
+
+struct printf_frag
+{
+    char *data;                 // Fragment buffer
+    unsigned size;              // Size of the buffer
+    unsigned len;               // Chars in the buffer
+    struct printf_frag *next;   // Next fragment, null at the end of the chain
+};
+
+extern printf_t printf_chain(struct printf_frag *chain, const char *fmt, ...);
+
+/*************************************************************************
+Memory-mapped log file (PRINTF_MMAP)
+
+printf_mmap_open() maps a log file for appending, after any text already
+in it. Each printf_mmap() call formats one record into a line buffer on the
+stack, then reserves space for it with an atomic add on the write offset
+and copies it into the mapping, so threads can log at the same time with
+no locks and no system calls. The file is grown in steps of extent bytes,
+and only then is a lock taken. The whole limit is mapped at the start so
+the mapping never moves while other threads are writing. A record which
+would pass the limit is dropped and counted. Space reserved by a thread
+reads as zeros until it has been written. printf_mmap_close() cuts the
+file back to the end of the last record.
+
+A record longer than PRINTF_MMAP_LINE is cut short, but the full length
+is returned.
+*************************************************************************/
+
+#ifndef PRINTF_MMAP_LINE
+    #define PRINTF_MMAP_LINE    256
+#endif
+
+struct printf_mmap
+{
+    char *map;                  // Start of the mapping
+    unsigned long head;         // Offset of the next record, updated atomically
+    unsigned long end;          // End of the last record written, updated atomically
+    unsigned long size;         // Current size of the file
+    unsigned long limit;        // Size of the mapping, the most the file can hold
+    unsigned long extent;       // Amount the file grows by
+    unsigned long dropped;      // Records which did not fit
+    int fd;                     // The log file
+    unsigned char growing;      // Lock held while the file is grown
+};
+
+extern int printf_mmap_open(struct printf_mmap *log, const char *path,
+                            unsigned long limit, unsigned long extent);
+extern printf_t printf_mmap(struct printf_mmap *log, const char *fmt, ...);
+extern int printf_mmap_close(struct printf_mmap *log);
+
+/*************************************************************************
+Sharded log buffers (PRINTF_SHARD)
+
+Each core or thread has its own struct printf_shard, a ring buffer which
+only it writes into, so printf_shard() needs no lock. Each record holds
+a time stamp from PRINTF_SHARD_TIME() taken at the start of the call,
+its length and its text, which is formatted directly into the ring.
+A record which does not fit is dropped and counted.
+
+printf_shard_drain() is called from one place, e.g. a low priority task,
+and sends the waiting records from all the shards to the output function
+in time stamp order, up to the number given, or all if it is zero. It
+returns the number sent. A record still being written when the drain
+runs is sent by a later one, possibly after records stamped later.
+*************************************************************************/
+
+struct printf_shard
+{
+    char *buf;                  // Ring buffer
+    unsigned size;              // Size of the buffer
+    volatile unsigned head;     // End of the last complete record, set by the writer
+    volatile unsigned tail;     // Start of the oldest record, set by the drain
+    unsigned pos;               // Write position in the current record
+    unsigned char full;         // The current record did not fit
+    unsigned long dropped;      // Records which did not fit
+};
+
+extern void printf_shard_init(struct printf_shard *shard, char *buf, unsigned size);
+extern printf_t printf_shard(struct printf_shard *shard, const char *fmt, ...);
+extern unsigned printf_shard_drain(struct printf_shard *shards, unsigned count,
+                                   unsigned max, void (*put)(char c));
+
+/*************************************************************************
+CBOR output (PRINTF_CBOR)
+
+printf_cbor() takes the same format and arguments as sprintf, but encodes
+the arguments as a CBOR (RFC 8949) map instead of formatting them as text.
+The letters, digits and '_' in the literal text before a conversion make
+up its key, e.g. "temp=%d volts=%f" gives the keys "temp" and "volts".
+Up to PRINTF_CBOR_KEY chars are kept. A conversion with no key text is
+keyed by its position, starting from 0.
+
+Integer conversions give CBOR integers and floating point conversions
+give the smallest float which holds the value exactly. Strings and all
+other conversions give a byte string of their text, limited by precision.
+Width and flags are ignored.
+
+Returns the number of bytes needed. Only the first size are written.
+*************************************************************************/
+
+#ifndef PRINTF_CBOR_KEY
+    #define PRINTF_CBOR_KEY     16
+#endif
+
+extern unsigned printf_cbor(unsigned char *buf, unsigned size, const char *fmt, ...);
+
+/*************************************************************************
+Output to several sinks (PRINTF_TEE)
+
+printf_tee() formats once and sends the output to each sink in the list
+whose bit is set in enable, bit 0 for the first sink, so the same line
+can go to a console, a RAM buffer and a log without being formatted three
+times. Padding is sent to a sink in one call if it has a fill function,
+otherwise one char at a time. The enable mask is read once at the start of
+each call, so it can be changed at any time, e.g. to stop writing to a
+flash log while it is erased. There can be as many sinks as the bits in
+an unsigned.
+*************************************************************************/
+
+struct printf_sink
+{
+    void (*put)(char c, void *context);         // Output a char
+    void (*fill)(char c, int n, void *context); // Output n copies of c, or null
+    void *context;                              // Passed to the functions
+};
+
+struct printf_tee
+{
+    const struct printf_sink *sinks;    // List of sinks
+    unsigned char count;                // Number of sinks in the list
+    unsigned enable;                    // Mask of the sinks to use
+};
+
+extern printf_t printf_tee(struct printf_tee *tee, const char *fmt, ...);
+
+/*************************************************************************
+Resumable formatting (PRINTF_STEP)
+
+printf_step_init() sets up a context with a format and a pointer to the
+caller's argument list. Each call to printf_step() then writes as much
+output as fits in the space given and returns the number of chars
+written, which is less than space once the output is complete. All the
+formatting state is kept in the context, so the caller can do other work
+between steps. The argument list must stay valid until the end, so the
+function which called va_start() must not return before then.
+
+PRINTF_STEP_BUF must be larger than BUFMAX in printf.c, the size of the
+number buffer. It depends on the features selected and is up to 44 chars
+with USE_INT128, which is checked at compile time.
+*************************************************************************/
+
+#define PRINTF_STEP_BUF     48
+
+struct printf_step
+{
+    const char *fmt;            // Next char of the format
+    va_list *ap;                // Argument list, owned by the caller
+    const char *p;              // Text of the conversion being output, null if none
+    int width;                  // Field width remaining
+    int pad;                    // Leading spaces still to output
+    int prec;                   // Precision remaining, -1 if none
+    unsigned char flags;        // Internal flags for the conversion
+    const char *src;            // Rest of the %J or %Q string to escape
+    int limit;                  // Escaped chars remaining for %J or %Q, -1 if no limit
+    char escape;                // %J or %Q conversion letter while escaping, else 0
+    char buf[PRINTF_STEP_BUF];  // Converted number text or escape sequence
+};
+
+extern void printf_step_init(struct printf_step *step, const char *fmt, va_list *ap);
+extern int printf_step(struct printf_step *step, char *out, int space);
+
+/*************************************************************************
+Level-filtered logging (PRINTF_LOG)
+
+printf_log(module, level, fmt, ...) prints through PRINTF_LOG_FUNC if the
+level is enabled for the module. Levels above PRINTF_LOG_LEVEL are removed
+at compile time along with their arguments. PRINTF_LOG_LEVEL can be
+defined before including printf.h to set it for one file, or as -1 to
+remove all logging. The remaining levels are checked at run time against
+printf_log_mute[module], where bit (1 << level) turns the level off, so a
+disabled call costs one load and a branch and its arguments are not
+evaluated. Modules are numbered by the application from 0 to
+PRINTF_LOG_MODULES - 1. Needs C99 variadic macros.
+*************************************************************************/
+
+#define PRINTF_LOG_ERROR    0
+#define PRINTF_LOG_WARN     1
+#define PRINTF_LOG_INFO     2
+#define PRINTF_LOG_DEBUG    3
+#define PRINTF_LOG_TRACE    4
+
+#ifndef PRINTF_LOG_LEVEL
+    #define PRINTF_LOG_LEVEL    PRINTF_LOG_DEBUG
+#endif
+#ifndef PRINTF_LOG_MODULES
+    #define PRINTF_LOG_MODULES  8
+#endif
+#ifndef PRINTF_LOG_FUNC
+    #define PRINTF_LOG_FUNC     printf
+#endif
+
+extern unsigned char printf_log_mute[PRINTF_LOG_MODULES];
+
+#define printf_log(module, level, ...)                                      \
+    do {                                                                    \
+        if ((level) <= PRINTF_LOG_LEVEL &&                                  \
+            !(printf_log_mute[module] & (1 << (level))))                    \
+            PRINTF_LOG_FUNC(__VA_ARGS__);                                   \
+    } while (0)
+
 #endif
@@ -62,6 +62,31 @@ Example for AVR micros using GCC toolchain from WinAVR or Atmel Studio
 #define GET_FORMAT(p)   pgm_read_byte(p)
 */
 
+/*
+Reading flash a byte at a time is slow. If it can be copied in blocks,
+define GET_FORMAT_BLOCK(dst, src, n) to copy n bytes to RAM. The format and
+%S strings are then read FORMAT_BLOCK bytes at a time through a small
+window on the stack. A block may be read past the end of a string.
+
+#define GET_FORMAT_BLOCK(d, s, n)   memcpy_P(d, s, n)
+#define FORMAT_BLOCK                8
+*/
+
+/*
+Constant lookup tables used by printf can be placed in flash memory in the
+same way, so they are not copied to RAM at startup. FLASH_TABLE is the
+storage attribute for the tables. GET_TABLE_BYTE(ptr), GET_TABLE_DWORD(ptr)
+and GET_TABLE_DOUBLE(ptr) read a byte, a 32-bit value and a double from them.
+By default the tables are ordinary const data read with a normal pointer access.
+This covers the format class table, the floating point normalisation tables
+and the power of ten table used for exact conversion.
+
+#define FLASH_TABLE         PROGMEM
+#define GET_TABLE_BYTE(p)   pgm_read_byte(p)
+#define GET_TABLE_DWORD(p)  pgm_read_dword(p)
+#define GET_TABLE_DOUBLE(p) pgm_read_float(p)
+*/
+
 /*************************************************************************
 Output configuration
 
@@ -75,6 +100,82 @@ extern void UARTSendByte(char c);
 #define PUTCHAR_FUNC    UARTSendByte
 */
 
+/*
+Padding for fields wider than their text is output in one run. If the
+output can send n copies of a char faster than n calls to PUTCHAR_FUNC,
+define PUTFILL_FUNC to be the name of a function which does that.
+
+extern void UARTSendRun(char c, int n);
+#define PUTFILL_FUNC    UARTSendRun
+*/
+
+/*
+Define PRINTF_DMA to include printf_dma(), which formats into two buffers
+in turn and hands each one to a DMA transfer. See printf.h for details.
+Not available with BASIC_PRINTF_ONLY.
+
+#define PRINTF_DMA
+*/
+
+/*
+Define PRINTF_STEP to include printf_step(), which outputs a little at a
+time so a slow device does not hold up the caller. See printf.h for details.
+Not available with BASIC_PRINTF_ONLY.
+
+#define PRINTF_STEP
+*/
+
+/*
+Define PRINTF_CHAIN to include printf_chain(), which writes directly into
+a chain of buffer fragments such as network packet buffers. See printf.h
+for details. Not available with BASIC_PRINTF_ONLY.
+
+#define PRINTF_CHAIN
+*/
+
+/*
+Define PRINTF_MMAP to include printf_mmap(), which writes log lines from
+any number of threads into a memory-mapped file. It needs a POSIX host with
+mmap and the gcc atomic builtins. See printf.h for details.
+Not available with BASIC_PRINTF_ONLY.
+
+#define PRINTF_MMAP
+*/
+
+/*
+Define PRINTF_SHARD to include printf_shard(), which gives each core or
+thread its own log buffer, and printf_shard_drain() which merges them in
+time order. See printf.h and the sharded logging section below.
+Not available with BASIC_PRINTF_ONLY.
+
+#define PRINTF_SHARD
+*/
+
+/*
+Define PRINTF_CBOR to include printf_cbor(), which encodes the arguments of
+a format as a CBOR map instead of text, keyed by the literal text before
+each conversion. See printf.h for details. Not available with
+BASIC_PRINTF_ONLY.
+
+#define PRINTF_CBOR
+*/
+
+/*
+Define PRINTF_TEE to include printf_tee(), which formats once and sends
+the output to several sinks, each of which can be enabled or disabled.
+See printf.h for details. Not available with BASIC_PRINTF_ONLY.
+
+#define PRINTF_TEE
+*/
+
+/*
+Define PRINTF_LOG to include the level masks used by printf_log(), which
+checks the level of a log call before the arguments are evaluated. The
+levels compiled in and the output function are set in printf.h.
+
+#define PRINTF_LOG
+*/
+
 /*************************************************************************
 Compiler capability configuration
 
@@ -96,11 +197,85 @@ padded size of a single % expression), the width variables can normally
 be restricted to 8 bits. On small micros this saves a lot of code and
 variable space. On a 32-bit RISC it may increase code size due to type
 conversions. Choose the variable type to suit your CPU.
-Note that a signed type is required.
+Note that a signed type is required. Precision is held in the same type, so
+it is also limited to 127 with signed char.
 *************************************************************************/
 
 typedef signed char width_t;
 
+/*************************************************************************
+Bounded execution time
+
+For hard real-time use, define PRINTF_WCET to put a fixed limit on the
+work done for each conversion, whatever its arguments:
+- Width and precision are limited to PRINTF_WCET_CHARS.
+- Strings output at most PRINTF_WCET_CHARS chars, so a long or missing
+  terminator cannot hold up the caller. This includes %J and %Q text.
+- USE_SMALL_FLOAT normalises numbers outside 10^-16 to 10^16 in steps of
+  10^8 before steps of 10, which takes at most about 60 steps instead of
+  over 300 for denormals.
+PRINTF_WCET_CHARS must fit in width_t and be at least the size of the
+number buffer, which is checked when printf.c is compiled. Custom
+conversions and the output function are not covered by the limit.
+The steps taken are counted in printf_wcet_steps, see printf.h.
+*************************************************************************/
+
+/*
+#define PRINTF_WCET
+#define PRINTF_WCET_CHARS   64
+*/
+
+/*************************************************************************
+Custom conversions
+
+Maximum number of conversion letters that can be registered with
+printf_register() when USE_CUSTOM is enabled. Each entry takes a char
+and a function pointer of RAM.
+*************************************************************************/
+
+#define CUSTOM_MAX      4
+
+/*************************************************************************
+Instrumentation
+
+When USE_STATS is enabled, PRINTF_STATS_TIME() is read at the start and
+end of each conversion and each call. It should return a free-running
+count as an unsigned long, such as a cycle counter. Differences are taken
+modulo the size of unsigned long, so the counter may wrap. If it is not
+defined then call and byte counts are still kept but times are zero.
+*************************************************************************/
+
+/*
+Examples for a Cortex-M3 or later, x86 using gcc, and a POSIX host
+
+#define PRINTF_STATS_TIME()     (DWT->CYCCNT)
+#define PRINTF_STATS_TIME()     ((unsigned long) __builtin_ia32_rdtsc())
+#define PRINTF_STATS_TIME()     clock_ns()
+*/
+
+/*************************************************************************
+Sharded logging
+
+With PRINTF_SHARD, each record is stamped with PRINTF_SHARD_TIME(), which
+should return a count shared by all cores as an unsigned long, such as a
+system timer. The counter may wrap, provided records are drained within
+half its range. If it is not defined the stamps are all zero and records
+from different shards are output in shard order.
+
+PRINTF_SHARD_BARRIER() makes sure the text of a record is visible to the
+core draining it before the record is, and the other way round when the
+space is freed. By default it is the gcc full barrier where available.
+A single core micro which only logs from interrupts can define it empty.
+*************************************************************************/
+
+/*
+Examples for a Cortex-M with a shared timer, and a POSIX host
+
+#define PRINTF_SHARD_TIME()     (TIM2->CNT)
+#define PRINTF_SHARD_BARRIER()  __DMB()
+#define PRINTF_SHARD_TIME()     clock_ns()
+*/
+
 /*************************************************************************
 Features included in your build of printf. Use only the features you need
 to keep code size and execution time to a minimum.
@@ -121,6 +296,9 @@ Features and pre-defined sets are set out in the following sections.
         | USE_FLOAT       \
         | USE_LONG        \
         | USE_BINARY      \
+        | USE_CUSTOM      \
+        | USE_TIMESTAMP   \
+        | USE_HEX_FLOAT   \
         | USE_OCTAL       \
         | USE_SIGNED      \
         | USE_SIGNED_I    \
@@ -141,9 +319,17 @@ Features and pre-defined sets are set out in the following sections.
         | USE_SPECIAL     \
         | USE_SMALL_FLOAT \
         | USE_LONG_LONG   \
+        | USE_FORMAT_TABLE \
+        | USE_EXACT_FLOAT \
+        | USE_STATS       \
+        | USE_ESCAPE      \
+        | USE_INT128      \
 )
 
+// The set can also be chosen on the compiler command line, e.g. -DFEATURE_FLAGS=FULL_FLOAT
+#ifndef FEATURE_FLAGS
 #define FEATURE_FLAGS   SHORT_INT
+#endif
 
 /*************************************************************************
 End of customisations - Stop Editing!
@@ -200,6 +386,18 @@ These are combined as needed to produce the FEATURE_FLAGS macro.
 // Include support for %b binary specifier
 #define USE_BINARY      (1<<12)
 
+// Include support for registering custom conversions with printf_register()
+#define USE_CUSTOM      (1<<13)
+
+// Include support for %T ISO-8601 timestamps
+#define USE_TIMESTAMP   (1<<14)
+
+// Include support for %a and %A hexadecimal floating point.
+// This does not need floating point arithmetic, so can be used without USE_FLOAT.
+// Precision is capped at BUFMAX - 11 hex digits, 19 or 21 or 33 with USE_INT128,
+// so %.25a may print fewer zeros than the C library. A double has only 13 digits.
+#define USE_HEX_FLOAT   (1<<15)
+
 // Include precision support when floating point is not present.
 // Precision is automatically enabled when floating point support is used.
 #define USE_PRECISION   (1UL<<16)
@@ -227,11 +425,42 @@ These are combined as needed to produce the FEATURE_FLAGS macro.
 
 // Use smaller but less efficient floating point normalisation.
 // This is not recommended unless code space is critically low.
+// If RAM is the problem, put the normalisation tables in flash instead (see FLASH_TABLE).
 #define USE_SMALL_FLOAT (1UL<<24)
 
 // Include support for 64-bit integers e.g. "%lld"
 #define USE_LONG_LONG   (1UL<<25)
 
+// Parse format specifiers using a character class lookup table.
+// Each format character costs one table lookup instead of a chain of compares,
+// at the cost of a 96-byte table. Faster for format-heavy output.
+#define USE_FORMAT_TABLE (1UL<<26)
+
+// Print %f values with exact digits for any magnitude. Precision is held in
+// width_t, so it is at most 127 with signed char, or PRINTF_WCET_CHARS.
+// Output is written directly, so it is not limited by the buffer size and does
+// not fall back to %e. Uses big integer arithmetic with about 600 bytes of stack
+// for double precision. Requires stdint.h and 64-bit integer support.
+#define USE_EXACT_FLOAT (1UL<<27)
+
+// Count calls, output bytes and time for each type of conversion.
+// See printf_stats_snapshot() in printf.h and PRINTF_STATS_TIME() above.
+#define USE_STATS       (1UL<<28)
+
+// Normalise floating point numbers using an estimate of the decimal exponent
+// from the binary exponent, then a single multiply or divide by a power of ten.
+// Much faster than the default search where division is done in software,
+// at the cost of a larger table. Ignored if USE_SMALL_FLOAT is also set.
+#define USE_FAST_NORM   (1UL<<29)
+
+// Include support for %J and %Q, which output a string with JSON escaping or
+// as a quoted CSV field. Width and precision apply to the escaped text.
+#define USE_ESCAPE      (1UL<<30)
+
+// Include support for 128-bit integers with the C23 length modifier, e.g. "%w128u".
+// Needs USE_LONG_LONG and a compiler with __int128. Binary output is limited to 32 bits.
+#define USE_INT128      (1UL<<31)
+
 /*************************************************************************
 Pre-defined feature sets
 
@@ -0,0 +1,670 @@
+/*****************************************************************************
+es-printf  -  configurable printf for embedded systems
+
+scanf.c: Companion scanf functions using the printf feature flags.
+
+https://github.com/skirridsystems/es-printf
+
+******************************************************************************
+Copyright (c) 2006 - 2021 Skirrid Systems
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+******************************************************************************/
+
+#include <stdarg.h>
+#include "scanf.h"
+#include "printf_cfg.h"
+
+/* Define default macro to access the format string using a pointer. */
+#ifndef GET_FORMAT
+    #define GET_FORMAT(p)   (*(p))
+#endif
+
+/* Define default macros to place and access constant lookup tables. */
+#ifndef FLASH_TABLE
+    #define FLASH_TABLE
+#endif
+#ifndef GET_TABLE_DWORD
+    #define GET_TABLE_DWORD(p)  (*(p))
+#endif
+#ifndef GET_TABLE_DOUBLE
+    #define GET_TABLE_DOUBLE(p) (*(p))
+#endif
+
+/* Renames the functions if they have been defined as macros in scanf.h */
+#ifdef sscanf
+    #undef  sscanf
+    #define sscanf _sscnf
+#endif
+
+#ifdef vsscanf
+    #undef  vsscanf
+    #define vsscanf _vsscnf
+#endif
+
+// Macro used to check presence of a feature flag.
+// These are defined in print_cfg.h
+#define FEATURE(flag)   ((FEATURE_FLAGS) & (flag))
+
+// Integer conversions, and those with a prefix or base other than 10.
+#define SCAN_BASED      (FEATURE(USE_SIGNED_I) | FEATURE(USE_HEX_LOWER) | FEATURE(USE_HEX_UPPER) | \
+                         FEATURE(USE_OCTAL) | FEATURE(USE_BINARY))
+#define SCAN_INTEGER    (SCAN_BASED | FEATURE(USE_SIGNED) | FEATURE(USE_UNSIGNED))
+
+// Type used to collect integers, the largest which is enabled.
+#if FEATURE(USE_LONG_LONG)
+    typedef unsigned long long scan_uvalue_t;
+#elif FEATURE(USE_LONG)
+    typedef unsigned long scan_uvalue_t;
+#else
+    typedef unsigned scan_uvalue_t;
+#endif
+
+// Bit definitions in the flags variable
+#define SF_SUPPRESS     (1<<0)  // Read but do not assign, e.g. %*d
+#define SF_SHORT        (1<<1)  // h
+#define SF_CHAR         (1<<2)  // hh
+#define SF_LONG         (1<<3)  // l
+#define SF_XLONG        (1<<4)  // ll
+#define SF_NEG          (1<<5)  // Minus sign read
+
+// The input source with one char of lookahead.
+struct scan_src
+{
+    scanf_get_t get;        // Function to read the next char
+    void *context;          // Passed to the get function
+    int c;                  // Current char, -1 at the end of the input
+};
+
+#define NEXT(src)   ((src)->c = (src)->get((src)->context))
+
+// Decimal digits are collected in groups which fit in 32 bits.
+#define CHUNK_DIGITS    9
+
+#if SCAN_INTEGER || FEATURE(USE_FLOAT)
+static const unsigned long scan_pow10[CHUNK_DIGITS + 1] FLASH_TABLE = {
+    1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL,
+    1000000UL, 10000000UL, 100000000UL, 1000000000UL
+};
+#endif
+
+/* ---------------------------------------------------------------------------
+Function: scan_space()
+Return non-zero for the chars which isspace() accepts.
+--------------------------------------------------------------------------- */
+static unsigned char scan_space(int c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/* ---------------------------------------------------------------------------
+Function: skip_space()
+Skip white space in the input.
+--------------------------------------------------------------------------- */
+static void skip_space(struct scan_src *src)
+{
+    while (scan_space(src->c))
+        NEXT(src);
+}
+
+#if SCAN_INTEGER || FEATURE(USE_FLOAT)
+/* ---------------------------------------------------------------------------
+Function: scan_chunk()
+Read up to CHUNK_DIGITS decimal digits, limited by the field width.
+The value is returned in chunk and the number of digits read is returned.
+Collecting digits in a 32-bit value means that a long long needs only one
+wide multiply for each group instead of one for each digit.
+--------------------------------------------------------------------------- */
+static unsigned char scan_chunk(struct scan_src *src, int *width, unsigned long *chunk)
+{
+    unsigned long n = 0;
+    unsigned char i = 0;
+    unsigned char d;
+
+    while (i < CHUNK_DIGITS && *width != 0 && (d = (unsigned char) (src->c - '0')) < 10)
+    {
+        n = n * 10 + d;
+        ++i;
+        --*width;
+        NEXT(src);
+    }
+    *chunk = n;
+    return i;
+}
+
+/* ---------------------------------------------------------------------------
+Function: scan_sign()
+Read an optional sign, setting SF_NEG for a minus sign.
+--------------------------------------------------------------------------- */
+static void scan_sign(struct scan_src *src, int *width, unsigned char *flags)
+{
+    if ((src->c == '-' || src->c == '+') && *width != 0)
+    {
+        if (src->c == '-') *flags |= SF_NEG;
+        --*width;
+        NEXT(src);
+    }
+}
+#endif
+
+#if SCAN_INTEGER
+/* ---------------------------------------------------------------------------
+Function: scan_int()
+Read an integer in the given base. A base of 0 detects the base from the
+prefix as for %i. Bases other than 10 are powers of 2, so each digit is
+added with a shift. Returns zero if there were no digits.
+--------------------------------------------------------------------------- */
+static unsigned char scan_int(struct scan_src *src, unsigned char base, int width,
+                              unsigned char *flags, scan_uvalue_t *result)
+{
+    scan_uvalue_t value = 0;
+    unsigned char found = 0;
+    unsigned char shift;
+    unsigned char d;
+    unsigned long chunk;
+
+    scan_sign(src, &width, flags);
+    // A leading 0 may be part of a prefix, 0x only for %x or for %i.
+    if (base != 10 && src->c == '0' && width != 0)
+    {
+        found = 1;
+        --width;
+        NEXT(src);
+        if ((base == 0 || base == 16) && (src->c | 0x20) == 'x' && width != 0)
+        {
+            base = 16;
+            --width;
+            NEXT(src);
+        }
+        else if (base == 0)
+        {
+            base = 8;
+        }
+    }
+    if (base == 0 || base == 10)
+    {
+        while ((d = scan_chunk(src, &width, &chunk)) != 0)
+        {
+            value = value * GET_TABLE_DWORD(&scan_pow10[d]) + chunk;
+            found = 1;
+            if (d < CHUNK_DIGITS) break;
+        }
+    }
+    else
+    {
+        shift = (base == 16) ? 4 : (base == 8) ? 3 : 1;
+        for (; width != 0; --width)
+        {
+            d = (unsigned char) (src->c - '0');
+            if (d > 9)
+            {
+                d = (unsigned char) ((src->c | 0x20) - 'a' + 10);
+                if (d < 10) break;
+            }
+            if (d >= base) break;
+            value = (value << shift) | d;
+            found = 1;
+            NEXT(src);
+        }
+    }
+    if (*flags & SF_NEG) value = -value;
+    *result = value;
+    return found;
+}
+
+/* ---------------------------------------------------------------------------
+Function: store_int()
+Assign an integer to the next argument, with the size given by the flags.
+--------------------------------------------------------------------------- */
+static void store_int(va_list *ap, unsigned char flags, scan_uvalue_t value)
+{
+#if FEATURE(USE_LONG_LONG)
+    if (flags & SF_XLONG)
+        *va_arg(*ap, unsigned long long *) = value;
+    else
+#endif
+#if FEATURE(USE_LONG)
+    if (flags & SF_LONG)
+        *va_arg(*ap, unsigned long *) = (unsigned long) value;
+    else
+#endif
+    if (flags & SF_CHAR)
+        *va_arg(*ap, unsigned char *) = (unsigned char) value;
+    else if (flags & SF_SHORT)
+        *va_arg(*ap, unsigned short *) = (unsigned short) value;
+    else
+        *va_arg(*ap, unsigned *) = (unsigned) value;
+}
+#endif
+
+#if FEATURE(USE_FLOAT)
+/*****************************************************************************
+Floating point input
+
+The digits are collected in 32-bit groups and combined, so there is one
+floating point multiply for every nine digits. The decimal exponent is then
+applied by multiplying or dividing by a power of ten made from a table of
+binary powers. The result may differ from the library in the last few bits.
+******************************************************************************/
+
+static const double scan_pow2_10[] FLASH_TABLE = {
+    1e1, 1e2, 1e4, 1e8, 1e16, 1e32,
+#ifndef NO_DOUBLE_PRECISION
+    1e64, 1e128, 1e256
+#endif
+};
+
+// The largest power of ten which is in range, the power applied in each
+// step of a larger scale, which is the last in the table, and the largest
+// exponent which can give a result other than zero or infinity.
+#ifndef NO_DOUBLE_PRECISION
+    #define SCAN_POW_MAX    308
+    #define SCAN_STEP_MAX   256
+    #define SCAN_EXP_MAX    360
+#else
+    #define SCAN_POW_MAX    38
+    #define SCAN_STEP_MAX   32
+    #define SCAN_EXP_MAX    80
+#endif
+
+/* ---------------------------------------------------------------------------
+Function: scan_mantissa()
+Read digits into value, adding each group to the value. Returns the number
+of digits read. Digits beyond the precision of a double are only counted,
+and are returned in extra so the exponent can be adjusted.
+--------------------------------------------------------------------------- */
+static int scan_mantissa(struct scan_src *src, int *width, double *value, int *extra)
+{
+    unsigned long chunk;
+    unsigned char d;
+    int total = 0;
+
+    while ((d = scan_chunk(src, width, &chunk)) != 0)
+    {
+        total += d;
+        if (*value < 1e18)
+            *value = *value * (double) GET_TABLE_DWORD(&scan_pow10[d]) + (double) chunk;
+        else
+            *extra += d;
+        if (d < CHUNK_DIGITS) break;
+    }
+    return total;
+}
+
+/* ---------------------------------------------------------------------------
+Function: scan_float()
+Read a floating point number. Returns zero if there were no digits.
+--------------------------------------------------------------------------- */
+static unsigned char scan_float(struct scan_src *src, int width, unsigned char *flags, double *result)
+{
+    double value = 0.0;
+    double scale = 1.0;
+    int exp10 = 0;
+    int digits;
+    int frac;
+    int n;
+    int step;
+    unsigned char i;
+    unsigned char eflags = 0;
+    unsigned long chunk;
+
+    scan_sign(src, &width, flags);
+    digits = scan_mantissa(src, &width, &value, &exp10);
+    if (src->c == '.' && width != 0)
+    {
+        --width;
+        NEXT(src);
+        // Each digit after the point which is used reduces the exponent.
+        n = 0;
+        frac = scan_mantissa(src, &width, &value, &n);
+        exp10 -= frac - n;
+        digits += frac;
+    }
+    if (digits == 0) return 0;
+    if ((src->c | 0x20) == 'e' && width != 0)
+    {
+        --width;
+        NEXT(src);
+        scan_sign(src, &width, &eflags);
+        n = scan_chunk(src, &width, &chunk) ? (int) chunk : 0;
+        exp10 += (eflags & SF_NEG) ? -n : n;
+    }
+    // Apply 10^|exp10| made from the binary powers, in one step if it is
+    // in range. Otherwise it is split so the value only goes to zero or
+    // infinity if the result does, which it always does beyond SCAN_EXP_MAX.
+    n = (exp10 < 0) ? -exp10 : exp10;
+    if (n > SCAN_EXP_MAX) n = SCAN_EXP_MAX;
+    while (n != 0)
+    {
+        step = (n > SCAN_POW_MAX) ? SCAN_STEP_MAX : n;
+        n -= step;
+        scale = 1.0;
+        for (i = 0; step != 0; i++, step >>= 1)
+        {
+            if (step & 1) scale *= GET_TABLE_DOUBLE(&scan_pow2_10[i]);
+        }
+        if (exp10 < 0) value /= scale;
+        else           value *= scale;
+    }
+    if (*flags & SF_NEG) value = -value;
+    *result = value;
+    return 1;
+}
+#endif
+
+/* ---------------------------------------------------------------------------
+Function: doscan()
+Main scanf function. Reads the input from the source according to the
+format and assigns the values to the arguments.
+Returns the number of items assigned, or -1 if the input ended before the
+first conversion.
+--------------------------------------------------------------------------- */
+static int doscan(struct scan_src *src, const char *fmt, va_list *ap)
+{
+    int count = 0;
+    int width;
+    char c;
+    unsigned char flags;
+#if SCAN_INTEGER
+    unsigned char base;
+    scan_uvalue_t uvalue;
+#endif
+#if FEATURE(USE_CHAR) || FEATURE(USE_STRING)
+    char *s;
+#endif
+#if FEATURE(USE_FLOAT)
+    double fvalue;
+#endif
+
+    NEXT(src);
+    for (;;)
+    {
+        c = GET_FORMAT(fmt);
+        if (c == '\0') break;
+        ++fmt;
+        // White space in the format matches any amount of white space.
+        if (scan_space(c))
+        {
+            skip_space(src);
+            continue;
+        }
+        if (c == '%')
+        {
+            c = GET_FORMAT(fmt);
+            ++fmt;
+            if (c == '%')
+            {
+                // %% matches a % after any white space.
+                skip_space(src);
+            }
+            else
+            {
+                flags = 0;
+#if FEATURE(USE_INDIRECT)
+                if (c == '*')
+                {
+                    flags |= SF_SUPPRESS;
+                    c = GET_FORMAT(fmt);
+                    ++fmt;
+                }
+#endif
+                // Maximum field width, unlimited if not given.
+                width = -1;
+                if (c >= '1' && c <= '9')
+                {
+                    width = 0;
+                    do
+                    {
+                        width = width * 10 + (c - '0');
+                        c = GET_FORMAT(fmt);
+                        ++fmt;
+                    } while (c >= '0' && c <= '9');
+                }
+                // Size of the argument.
+                if (c == 'h')
+                {
+                    c = GET_FORMAT(fmt);
+                    ++fmt;
+                    flags |= SF_SHORT;
+                    if (c == 'h')
+                    {
+                        c = GET_FORMAT(fmt);
+                        ++fmt;
+                        flags |= SF_CHAR;
+                    }
+                }
+#if FEATURE(USE_LONG) || FEATURE(USE_FLOAT)
+                else if (c == 'l')
+                {
+                    c = GET_FORMAT(fmt);
+                    ++fmt;
+                    flags |= SF_LONG;
+    #if FEATURE(USE_LONG_LONG)
+                    if (c == 'l')
+                    {
+                        c = GET_FORMAT(fmt);
+                        ++fmt;
+                        flags |= SF_XLONG;
+                    }
+    #endif
+                }
+#endif
+                // All conversions except %c skip leading white space.
+                if (c != 'c') skip_space(src);
+                if (src->c < 0) goto input_end;
+
+#if SCAN_INTEGER
+                base = 10;
+#endif
+                switch (c)
+                {
+#if FEATURE(USE_SIGNED_I)
+                case 'i':
+                    base = 0;
+                    goto scan_integer;
+#endif
+#if FEATURE(USE_HEX_LOWER) || FEATURE(USE_HEX_UPPER)
+    #if FEATURE(USE_HEX_LOWER)
+                case 'x':
+    #endif
+    #if FEATURE(USE_HEX_UPPER)
+                case 'X':
+    #endif
+                    base = 16;
+                    goto scan_integer;
+#endif
+#if FEATURE(USE_OCTAL)
+                case 'o':
+                    base = 8;
+                    goto scan_integer;
+#endif
+#if FEATURE(USE_BINARY)
+                case 'b':
+                    base = 2;
+                    goto scan_integer;
+#endif
+#if FEATURE(USE_SIGNED)
+                case 'd':
+#endif
+#if FEATURE(USE_UNSIGNED)
+                case 'u':
+#endif
+#if SCAN_BASED
+                scan_integer:
+#endif
+#if SCAN_INTEGER
+                    if (!scan_int(src, base, width, &flags, &uvalue)) return count;
+                    if (!(flags & SF_SUPPRESS))
+                    {
+                        store_int(ap, flags, uvalue);
+                        ++count;
+                    }
+                    break;
+#endif
+#if FEATURE(USE_CHAR)
+                case 'c':
+                    // Read exactly the width given, default 1, including white space.
+                    if (width < 0) width = 1;
+                    s = (flags & SF_SUPPRESS) ? 0 : va_arg(*ap, char *);
+                    for (; width != 0 && src->c >= 0; --width)
+                    {
+                        if (s) *s++ = (char) src->c;
+                        NEXT(src);
+                    }
+                    if (width != 0) return count;
+                    if (s) ++count;
+                    break;
+#endif
+#if FEATURE(USE_STRING)
+                case 's':
+                    s = (flags & SF_SUPPRESS) ? 0 : va_arg(*ap, char *);
+                    for (; width != 0 && src->c >= 0 && !scan_space(src->c); --width)
+                    {
+                        if (s) *s++ = (char) src->c;
+                        NEXT(src);
+                    }
+                    if (s)
+                    {
+                        *s = '\0';
+                        ++count;
+                    }
+                    break;
+#endif
+#if FEATURE(USE_FLOAT)
+                case 'f':
+                case 'e':
+                case 'g':
+                case 'E':
+                case 'G':
+                    if (!scan_float(src, width, &flags, &fvalue)) return count;
+                    if (!(flags & SF_SUPPRESS))
+                    {
+                        if (flags & SF_LONG)
+                            *va_arg(*ap, double *) = fvalue;
+                        else
+                            *va_arg(*ap, float *) = (float) fvalue;
+                        ++count;
+                    }
+                    break;
+#endif
+                default:
+                    // Unsupported conversion.
+                    return count;
+                }
+                continue;
+            }
+        }
+        // Literal chars and %% must match the input.
+        if (src->c < 0) goto input_end;
+        if (src->c != c) break;
+        NEXT(src);
+    }
+    return count;
+
+input_end:
+    // The input ended before a conversion or literal could be matched.
+    return count ? count : -1;
+}
+
+/* ---------------------------------------------------------------------------
+Function: getstr()
+This is the input function used for sscanf.
+The context is a pointer to the string pointer.
+--------------------------------------------------------------------------- */
+static int getstr(void *context)
+{
+    const char *str = *((const char **) context);
+
+    if (*str == '\0') return -1;
+    *((const char **) context) = str + 1;
+    return (unsigned char) *str;
+}
+
+/* ---------------------------------------------------------------------------
+Function: vsscanf()
+Replacement for library vsscanf - reads from the string supplied.
+--------------------------------------------------------------------------- */
+int vsscanf(const char *str, const char *fmt, va_list ap)
+{
+    struct scan_src src;
+    va_list aq;
+    int count;
+
+    src.get = getstr;
+    src.context = &str;
+    va_copy(aq, ap);
+    count = doscan(&src, fmt, &aq);
+    va_end(aq);
+    return count;
+}
+
+/* ---------------------------------------------------------------------------
+Function: sscanf()
+Replacement for library sscanf - reads from the string supplied.
+--------------------------------------------------------------------------- */
+int sscanf(const char *str, const char *fmt, ...)
+{
+    struct scan_src src;
+    va_list ap;
+    int count;
+
+    src.get = getstr;
+    src.context = &str;
+    va_start(ap, fmt);
+    count = doscan(&src, fmt, &ap);
+    va_end(ap);
+    return count;
+}
+
+/* ---------------------------------------------------------------------------
+Function: vfnscanf()
+scanf with the input read from a function, e.g. from a UART or from a
+string in flash memory.
+--------------------------------------------------------------------------- */
+int vfnscanf(scanf_get_t get, void *context, const char *fmt, va_list ap)
+{
+    struct scan_src src;
+    va_list aq;
+    int count;
+
+    src.get = get;
+    src.context = context;
+    va_copy(aq, ap);
+    count = doscan(&src, fmt, &aq);
+    va_end(aq);
+    return count;
+}
+
+/* ---------------------------------------------------------------------------
+Function: fnscanf()
+scanf with the input read from a function.
+--------------------------------------------------------------------------- */
+int fnscanf(scanf_get_t get, void *context, const char *fmt, ...)
+{
+    struct scan_src src;
+    va_list ap;
+    int count;
+
+    src.get = get;
+    src.context = context;
+    va_start(ap, fmt);
+    count = doscan(&src, fmt, &ap);
+    va_end(ap);
+    return count;
+}
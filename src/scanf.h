@@ -0,0 +1,84 @@
+/*************************************************************************
+es-printf  -  configurable printf for embedded systems
+
+scanf.h: Header for consumers of scanf functions.
+
+https://github.com/skirridsystems/es-printf
+
+**************************************************************************
+Copyright (c) 2006 - 2021 Skirrid Systems
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*************************************************************************/
+
+#ifndef SCANF_H
+#define SCANF_H
+
+#include <stdarg.h>
+
+/*************************************************************************
+Memory access definitions
+
+As for printf, the format string can be kept in flash memory by wrapping
+it in a macro and calling a renamed version of sscanf. The format is then
+read with the GET_FORMAT() macro from printf_cfg.h.
+*************************************************************************/
+
+/*
+Example for AVR micros using GCC toolchain from WinAVR or Atmel Studio
+
+#define sscanf(str, format, args...)    _sscnf(str, PSTR(format), ## args)
+
+extern int _sscnf(const char *, const char *, ...);
+*/
+
+
+
+/*************************************************************************
+End of customisations - Stop Editing!
+
+The remainder of this file contains the function declarations.
+*************************************************************************/
+
+/*
+The conversions available are chosen by FEATURE_FLAGS in printf_cfg.h,
+so the input and output sides of a program support the same set.
+Each function returns the number of items assigned, or -1 if the input
+ended before the first conversion.
+
+fnscanf() reads its input from a function, which returns the next char
+or -1 at the end of the input. One char is read beyond the end of the
+last item, in the same way as the library scanf.
+*/
+
+typedef int (*scanf_get_t)(void *context);
+
+// Function declarations, unless macros have been defined above
+#ifndef sscanf
+extern int sscanf(const char *str, const char *fmt, ...);
+#endif
+
+#ifndef vsscanf
+extern int vsscanf(const char *str, const char *fmt, va_list ap);
+#endif
+
+extern int fnscanf(scanf_get_t get, void *context, const char *fmt, ...);
+extern int vfnscanf(scanf_get_t get, void *context, const char *fmt, va_list ap);
+
+#endif
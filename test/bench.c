@@ -0,0 +1,356 @@
+/*************************************************************************
+es-printf  -  configurable printf for embedded systems
+
+Benchmark workload used to compare the cost per call of each type of
+conversion across architectures and feature sets.
+
+https://github.com/skirridsystems/es-printf
+
+**************************************************************************
+Copyright (c) 2006 - 2021 Skirrid Systems
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*************************************************************************/
+
+/* The benchmark formats a fixed set of cases into a buffer with sprintf,
+   so the cost of the output device is not included. It runs in one of
+   two modes, chosen by the target section below.
+
+   If BENCH_TIME() is defined the program reads a counter itself and
+   runs every case, printing one line per case:
+       @bench <case> <count per call>
+   This is used for AVR under simavr, which is cycle accurate, and for
+   a native build on the host.
+
+   Otherwise the count comes from the emulator. With no arguments the
+   program lists the case names. With a case number and a loop count it
+   runs that case and exits. The difference between the instruction
+   counts for a loop count of zero and N, divided by N, is the count
+   per call. This is used for ARM and RISC-V under qemu.
+
+   The feature set is given on the command line with -DFEATURE_FLAGS.
+   Building with -DPRINTF_WCET adds the worst case for each conversion.
+   See bench.sh for the build and run steps.
+*/
+
+#if defined(__AVR__)
+    // AVR under simavr, timed with Timer1 at the CPU clock.
+    #include <avr/io.h>
+    #include <avr/interrupt.h>
+    #include <avr/sleep.h>
+    #include "avr_mcu_section.h"
+
+    AVR_MCU(F_CPU, "atmega328p");
+    AVR_MCU_SIMAVR_CONSOLE(&GPIOR0);
+
+    #define NO_DOUBLE_PRECISION
+    #define PUTCHAR_FUNC    outchar
+    #define BENCH_TIME()    avr_cycles()
+    #define BENCH_UNIT      "cycles"
+
+    static volatile unsigned t1_high;
+
+    ISR(TIMER1_OVF_vect)
+    {
+        ++t1_high;
+    }
+
+    static unsigned long avr_cycles(void)
+    {
+        unsigned lo, hi;
+
+        cli();
+        lo = TCNT1;
+        hi = t1_high;
+        // Allow for an overflow which has not been serviced yet.
+        if ((TIFR1 & _BV(TOV1)) && lo < 0x8000) ++hi;
+        sei();
+        return ((unsigned long) hi << 16) | lo;
+    }
+
+    static void outchar(char c)
+    {
+        GPIOR0 = c;     // simavr console register
+    }
+
+    static void bench_init(void)
+    {
+        TCCR1B = _BV(CS10);
+        TIMSK1 = _BV(TOIE1);
+        sei();
+    }
+
+    static void bench_exit(void)
+    {
+        // simavr stops when the CPU sleeps with interrupts off.
+        cli();
+        sleep_mode();
+    }
+#elif defined(BENCH_EMU)
+    // ARM and RISC-V under qemu, counted by the emulator.
+    #include <unistd.h>
+
+    #define PUTCHAR_FUNC    outchar
+
+    static void outchar(char c)
+    {
+        (void) write(1, &c, 1);
+    }
+
+    static void bench_init(void) {}
+    static void bench_exit(void) {}
+#else
+    // Native host build, timed by the system clock.
+    #define _POSIX_C_SOURCE 199309L
+    #include <time.h>
+    #include <unistd.h>
+
+    #define PUTCHAR_FUNC    outchar
+    #define BENCH_TIME()    host_ns()
+    #define BENCH_UNIT      "ns"
+
+    static unsigned long host_ns(void)
+    {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long) ts.tv_sec * 1000000000UL + ts.tv_nsec;
+    }
+
+    static void outchar(char c)
+    {
+        (void) write(1, &c, 1);
+    }
+
+    static void bench_init(void) {}
+    static void bench_exit(void) {}
+#endif
+
+#include <float.h>
+
+/* Include the printf source here so the feature set and output function
+   given above are used, in the same way as the test program.
+*/
+#include "../src/printf.c"
+
+#ifndef BENCH_LOOPS
+    #define BENCH_LOOPS     100
+#endif
+
+#ifdef PRINTF_WCET
+    // Worst case output with the limits on each conversion.
+    static char buf[PRINTF_WCET_CHARS + 1];
+#else
+    static char buf[64];
+#endif
+
+/* ---------------------------------------------------------------------------
+Benchmark cases. Each one makes a single sprintf call.
+--------------------------------------------------------------------------- */
+static void b_text(void)    { sprintf(buf, "Benchmark text only\n"); }
+#if FEATURE(USE_SIGNED)
+static void b_dec(void)     { sprintf(buf, "%d", -12345); }
+#endif
+#if FEATURE(USE_SIGNED) && FEATURE(USE_SPACE_PAD)
+static void b_dec_pad(void) { sprintf(buf, "%8d", 678); }
+#endif
+#if FEATURE(USE_HEX_LOWER)
+static void b_hex(void)     { sprintf(buf, "%x", 0xbeefU); }
+#endif
+#if FEATURE(USE_SIGNED) && FEATURE(USE_LONG)
+static void b_long(void)    { sprintf(buf, "%ld", -123456789L); }
+#endif
+#if FEATURE(USE_STRING)
+static void b_str(void)     { sprintf(buf, "%s", "Abcdefgh"); }
+#endif
+#if FEATURE(USE_STRING) && FEATURE(USE_LEFT_JUST)
+static void b_str_pad(void) { sprintf(buf, "%-12s|", "Abcdefgh"); }
+#endif
+#if FEATURE(USE_FLOAT)
+static void b_f(void)       { sprintf(buf, "%f", 3.14159265); }
+static void b_e(void)       { sprintf(buf, "%e", 1.2345e-10); }
+static void b_g(void)       { sprintf(buf, "%g", 123456.0); }
+#endif
+#if FEATURE(USE_SIGNED) && FEATURE(USE_UNSIGNED) && FEATURE(USE_STRING) && FEATURE(USE_ZERO_PAD)
+static void b_mixed(void)   { sprintf(buf, "T=%d.%02u V=%u %s\n", 21, 5U, 3300U, "OK"); }
+#endif
+
+/* With PRINTF_WCET the worst case arguments for each conversion are timed
+   as well, to give the maximum count per conversion for the target.
+*/
+#ifdef PRINTF_WCET
+    #if FEATURE(USE_STRING)
+static const char wc_text[] = "Long text which is cut short at the output limit for each conversion "
+                              "so a missing terminator cannot hold up the caller";
+static void w_str(void)     { sprintf(buf, "%s", wc_text); }
+    #endif
+    #if FEATURE(USE_SIGNED) && FEATURE(USE_SPACE_PAD) && FEATURE(USE_PRECISION)
+static void w_dec(void)     { sprintf(buf, "%127.127d", -32767); }
+    #endif
+    #if FEATURE(USE_FLOAT) && FEATURE(USE_SPACE_PAD)
+static void w_emax(void)    { sprintf(buf, "%127.127e", -DBL_MAX); }
+static void w_emin(void)    { sprintf(buf, "%127.127e", DBL_MIN / 8.0); }
+    #endif
+#endif
+
+static const struct
+{
+    const char *name;
+    void (*run)(void);
+} cases[] = {
+    { "text",       b_text },
+#if FEATURE(USE_SIGNED)
+    { "%d",         b_dec },
+#endif
+#if FEATURE(USE_SIGNED) && FEATURE(USE_SPACE_PAD)
+    { "%8d",        b_dec_pad },
+#endif
+#if FEATURE(USE_HEX_LOWER)
+    { "%x",         b_hex },
+#endif
+#if FEATURE(USE_SIGNED) && FEATURE(USE_LONG)
+    { "%ld",        b_long },
+#endif
+#if FEATURE(USE_STRING)
+    { "%s",         b_str },
+#endif
+#if FEATURE(USE_STRING) && FEATURE(USE_LEFT_JUST)
+    { "%-12s",      b_str_pad },
+#endif
+#if FEATURE(USE_FLOAT)
+    { "%f",         b_f },
+    { "%e",         b_e },
+    { "%g",         b_g },
+#endif
+#if FEATURE(USE_SIGNED) && FEATURE(USE_UNSIGNED) && FEATURE(USE_STRING) && FEATURE(USE_ZERO_PAD)
+    { "mixed",      b_mixed },
+#endif
+#ifdef PRINTF_WCET
+    #if FEATURE(USE_STRING)
+    { "%s:max",     w_str },
+    #endif
+    #if FEATURE(USE_SIGNED) && FEATURE(USE_SPACE_PAD) && FEATURE(USE_PRECISION)
+    { "%d:max",     w_dec },
+    #endif
+    #if FEATURE(USE_FLOAT) && FEATURE(USE_SPACE_PAD)
+    { "%e:max",     w_emax },
+    { "%e:min",     w_emin },
+    #endif
+#endif
+};
+
+#define NCASES  (sizeof(cases) / sizeof(cases[0]))
+
+/* ---------------------------------------------------------------------------
+Function: outstr()
+Output text directly, so the results can be shown with any feature set,
+including those without %s.
+--------------------------------------------------------------------------- */
+static void outstr(const char *s)
+{
+    while (*s)
+        outchar(*s++);
+}
+
+/* ---------------------------------------------------------------------------
+Function: run_case()
+Run a case the given number of times.
+--------------------------------------------------------------------------- */
+static void run_case(unsigned char i, unsigned long loops)
+{
+    while (loops--)
+        cases[i].run();
+}
+
+#ifdef BENCH_TIME
+/* ---------------------------------------------------------------------------
+Function: ultoa10()
+Convert an unsigned long to decimal text. Used for the results so they can
+be output with any feature set, including those without long support.
+--------------------------------------------------------------------------- */
+static char *ultoa10(unsigned long n, char *end)
+{
+    *end = '\0';
+    do
+    {
+        *--end = (char) (n % 10 + '0');
+        n /= 10;
+    } while (n);
+    return end;
+}
+
+int main(void)
+{
+    unsigned char i;
+    unsigned long t0, t1, t2;
+    char num[12];
+
+    bench_init();
+    for (i = 0; i < NCASES; i++)
+    {
+        // Time an empty loop as well so its overhead can be removed.
+        t0 = BENCH_TIME();
+        run_case(i, 0);
+        t1 = BENCH_TIME();
+        run_case(i, BENCH_LOOPS);
+        t2 = BENCH_TIME();
+        outstr("@bench ");
+        outstr(cases[i].name);
+        outstr(" ");
+        outstr(ultoa10(((t2 - t1) - (t1 - t0)) / BENCH_LOOPS, num + sizeof(num) - 1));
+        outstr(" " BENCH_UNIT "\n");
+    }
+    bench_exit();
+    return 0;
+}
+#else
+/* ---------------------------------------------------------------------------
+Function: atoul()
+Convert decimal text to an unsigned long.
+--------------------------------------------------------------------------- */
+static unsigned long atoul(const char *s)
+{
+    unsigned long n = 0;
+
+    while (*s >= '0' && *s <= '9')
+        n = n * 10 + (unsigned long) (*s++ - '0');
+    return n;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned char i;
+
+    bench_init();
+    if (argc < 3)
+    {
+        for (i = 0; i < NCASES; i++)
+        {
+            outstr(cases[i].name);
+            outstr("\n");
+        }
+    }
+    else if (atoul(argv[1]) < NCASES)
+    {
+        run_case((unsigned char) atoul(argv[1]), atoul(argv[2]));
+    }
+    bench_exit();
+    return 0;
+}
+#endif
@@ -0,0 +1,200 @@
+#!/bin/sh
+#*************************************************************************
+# es-printf  -  configurable printf for embedded systems
+#
+# Benchmark runner. Cross-builds bench.c for each architecture and
+# feature set, runs it under an emulator and prints a table of the
+# count per call for each case.
+#
+# https://github.com/skirridsystems/es-printf
+#
+#*************************************************************************
+# Copyright (c) 2006 - 2021 Skirrid Systems
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+# DEALINGS IN THE SOFTWARE.
+#*****************************************************************************/
+
+# Architectures:
+#   armv6m  Cortex-M0, arm-none-eabi-gcc, qemu-arm instruction count
+#   armv7m  Cortex-M3, arm-none-eabi-gcc, qemu-arm instruction count
+#   rv32    RV32IMAC, riscv64-unknown-elf-gcc, qemu-riscv32 instruction count
+#   avr     ATmega328P, avr-gcc, simavr cycle count
+#   host    Native gcc, nanoseconds
+#
+# qemu runs the bare-metal programs in user mode, using semihosting for ARM
+# and the newlib system calls for RISC-V. Instructions are counted with the
+# libinsn plugin which is built with qemu (tests/plugin or contrib/plugins).
+# Any architecture whose tools are not found is skipped.
+#
+# Everything can be overridden from the environment or the make command line.
+
+ARCHS=${ARCHS:-"armv6m armv7m rv32 avr"}
+SETS=${SETS:-"SHORT_INT LONG_INT FULL_FLOAT"}
+LOOPS=${LOOPS:-100}
+OPT=${OPT:--Os}
+# Other options for every build, e.g. DEFS=-DPRINTF_WCET for worst case counts.
+DEFS=${DEFS:-}
+
+ARM_GCC=${ARM_GCC:-arm-none-eabi-gcc}
+RISCV_GCC=${RISCV_GCC:-riscv64-unknown-elf-gcc}
+AVR_GCC=${AVR_GCC:-avr-gcc}
+HOST_GCC=${HOST_GCC:-gcc}
+QEMU_ARM=${QEMU_ARM:-qemu-arm}
+QEMU_RISCV=${QEMU_RISCV:-qemu-riscv32}
+QEMU_PLUGIN=${QEMU_PLUGIN:-/usr/lib/qemu/plugins/libinsn.so}
+SIMAVR=${SIMAVR:-simavr}
+SIMAVR_INC=${SIMAVR_INC:-/usr/include/simavr/avr}
+
+BENCH_OUT=${BENCH_OUT:-bench_out}
+RESULTS=$BENCH_OUT/results.txt
+
+have()
+{
+    command -v "$1" >/dev/null 2>&1
+}
+
+# Instruction count reported by the qemu plugin log.
+insns()
+{
+    sed -n 's/.*insns: *\([0-9][0-9]*\).*/\1/p' "$1" | tail -n 1
+}
+
+# Build bench.c for an architecture and feature set: build <arch> <set> <elf>
+build()
+{
+    case $1 in
+    armv6m) cc="$ARM_GCC -mcpu=cortex-m0 -mthumb --specs=rdimon.specs -DBENCH_EMU" ;;
+    armv7m) cc="$ARM_GCC -mcpu=cortex-m3 -mthumb --specs=rdimon.specs -DBENCH_EMU" ;;
+    rv32)   cc="$RISCV_GCC -march=rv32imac -mabi=ilp32 -DBENCH_EMU" ;;
+    avr)    cc="$AVR_GCC -mmcu=atmega328p -DF_CPU=16000000UL -I$SIMAVR_INC" ;;
+    host)   cc="$HOST_GCC" ;;
+    esac
+    $cc $OPT $DEFS -fno-builtin -DFEATURE_FLAGS="$2" -o "$3" bench.c -lm
+}
+
+# Run the program under qemu and print the instruction count: emu <arch> <elf> args...
+emu()
+{
+    arch=$1; elf=$2; shift 2
+    case $arch in
+    armv6m) $QEMU_ARM -cpu cortex-m0 -plugin "$QEMU_PLUGIN" -d plugin -D "$BENCH_OUT/insn.log" "$elf" "$@" ;;
+    armv7m) $QEMU_ARM -cpu cortex-m3 -plugin "$QEMU_PLUGIN" -d plugin -D "$BENCH_OUT/insn.log" "$elf" "$@" ;;
+    rv32)   $QEMU_RISCV -plugin "$QEMU_PLUGIN" -d plugin -D "$BENCH_OUT/insn.log" "$elf" "$@" ;;
+    esac >/dev/null
+    insns "$BENCH_OUT/insn.log"
+}
+
+# Run all cases and append "arch set case count unit" lines to the results.
+run()
+{
+    arch=$1; set=$2; elf=$3
+    case $arch in
+    avr)
+        $SIMAVR "$elf" 2>&1 | sed -n "s/.*@bench /$arch $set /p" >> "$RESULTS" ;;
+    host)
+        "$elf" | sed -n "s/^@bench /$arch $set /p" >> "$RESULTS" ;;
+    *)
+        # The case list comes from the program itself.
+        i=0
+        for name in $(emu_list "$arch" "$elf"); do
+            base=$(emu "$arch" "$elf" $i 0)
+            full=$(emu "$arch" "$elf" $i "$LOOPS")
+            if [ -n "$base" ] && [ -n "$full" ]; then
+                echo "$arch $set $name $(( (full - base) / LOOPS )) insns" >> "$RESULTS"
+            fi
+            i=$((i + 1))
+        done ;;
+    esac
+}
+
+emu_list()
+{
+    case $1 in
+    armv6m) $QEMU_ARM -cpu cortex-m0 "$2" ;;
+    armv7m) $QEMU_ARM -cpu cortex-m3 "$2" ;;
+    rv32)   $QEMU_RISCV "$2" ;;
+    esac
+}
+
+# Check the tools needed for an architecture: tools <arch>
+tools()
+{
+    case $1 in
+    armv6m|armv7m) need="$ARM_GCC $QEMU_ARM" ;;
+    rv32)          need="$RISCV_GCC $QEMU_RISCV" ;;
+    avr)           need="$AVR_GCC $SIMAVR" ;;
+    host)          need="$HOST_GCC" ;;
+    *)             echo "$1: unknown architecture" >&2; return 1 ;;
+    esac
+    for t in $need; do
+        if ! have "$t"; then
+            echo "$1: skipped, $t not found" >&2
+            return 1
+        fi
+    done
+    case $1 in
+    armv6m|armv7m|rv32)
+        if [ ! -f "$QEMU_PLUGIN" ]; then
+            echo "$1: skipped, qemu plugin $QEMU_PLUGIN not found" >&2
+            return 1
+        fi ;;
+    esac
+}
+
+mkdir -p "$BENCH_OUT"
+: > "$RESULTS"
+
+for arch in $ARCHS; do
+    tools "$arch" || continue
+    for set in $SETS; do
+        elf=$BENCH_OUT/bench_${arch}_$set.elf
+        if build "$arch" "$set" "$elf"; then
+            run "$arch" "$set" "$elf"
+        else
+            echo "$arch $set: build failed" >&2
+        fi
+    done
+done
+
+# Print one table per architecture with a column for each feature set.
+awk -v sets="$SETS" '
+    BEGIN { ns = split(sets, set, " ") }
+    {
+        if (!($1 in seen)) { seen[$1] = 1; arch[++na] = $1 }
+        key = $1 SUBSEP $3
+        if (!(key in known)) { known[key] = 1; cases[$1] = cases[$1] " " $3 }
+        count[$1, $2, $3] = $4
+        unit[$1] = $5
+    }
+    END {
+        for (a = 1; a <= na; a++) {
+            printf "\n%s (%s per call)\n%-10s", arch[a], unit[arch[a]], "case"
+            for (s = 1; s <= ns; s++) printf " %12s", set[s]
+            printf "\n"
+            n = split(cases[arch[a]], c, " ")
+            for (i = 1; i <= n; i++) {
+                printf "%-10s", c[i]
+                for (s = 1; s <= ns; s++) {
+                    k = arch[a] SUBSEP set[s] SUBSEP c[i]
+                    printf " %12s", (k in count) ? count[k] : "-"
+                }
+                printf "\n"
+            }
+        }
+    }' "$RESULTS"
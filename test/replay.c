@@ -0,0 +1,275 @@
+/*************************************************************************
+es-printf  -  configurable printf for embedded systems
+
+Trace replay benchmark. Replays a trace of sprintf calls through es-printf
+and the host C library, reporting throughput, latency percentiles and the
+number of calls whose output differs from the library.
+
+https://github.com/skirridsystems/es-printf
+
+**************************************************************************
+Copyright (c) 2006 - 2021 Skirrid Systems
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*************************************************************************/
+
+/* The trace (see trace_gen.c for the format) is turned into a header by
+   replay.sh, with one line per call:
+       R(<n>, "format", args...)
+   The header is included three times: once to make a function which
+   calls es-printf for each record, once to make one which calls the
+   library, and once to build the table of both. The arguments are
+   therefore passed with their real types, exactly as in the product.
+
+   The program is built once for each feature set with -DFEATURE_FLAGS.
+   Usage: replay [-l] [-v] [name] [loops]
+       -l      time the library instead of es-printf
+       -v      print the first few mismatches to stderr
+   Conversions outside the feature set can make es-printf read an argument
+   with the wrong type, which may fault. Such records are caught, counted
+   as mismatches and left out of the timing from then on.
+   It prints one line of results:
+       <name> <calls/s> <MB/s> <p50> <p90> <p99> <max> <mismatches>
+   with the latencies in nanoseconds. See replay.sh for the build steps.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <setjmp.h>
+
+/* Force printf.c to rename its functions so both versions can be used. */
+#define printf x
+#define sprintf x
+
+#include "../src/printf.c"
+
+#undef printf
+#undef sprintf
+
+#ifndef REPLAY_CASES
+    #define REPLAY_CASES    "replay_out/cases.h"
+#endif
+
+#define REPLAY_BUF      4096
+
+typedef void (*replay_fn)(char *buf);
+
+// Functions for each record through es-printf.
+#define R(n, ...)   static void es_##n(char *buf) { _sprntf(buf, __VA_ARGS__); }
+#include REPLAY_CASES
+#undef R
+
+// The same records through the library.
+#define R(n, ...)   static void lc_##n(char *buf) { sprintf(buf, __VA_ARGS__); }
+#include REPLAY_CASES
+#undef R
+
+static const struct
+{
+    replay_fn es;
+    replay_fn lc;
+} cases[] = {
+#define R(n, ...)   { es_##n, lc_##n },
+#include REPLAY_CASES
+#undef R
+};
+
+#define NCASES  (sizeof(cases) / sizeof(cases[0]))
+
+// Records which faulted, and the one being run for the fault handler.
+static char faulted[NCASES];
+static volatile unsigned current;
+static sigjmp_buf fault_jump;
+
+static char es_buf[REPLAY_BUF], lc_buf[REPLAY_BUF];
+
+static void on_fault(int sig)
+{
+    (void) sig;
+    siglongjmp(fault_jump, 1);
+}
+
+static unsigned long host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long) ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static int cmp_ul(const void *a, const void *b)
+{
+    unsigned long x = *(const unsigned long *) a;
+    unsigned long y = *(const unsigned long *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* ---------------------------------------------------------------------------
+Function: mismatches()
+Count the records where es-printf and the library give different output.
+A record which faults counts as a mismatch.
+--------------------------------------------------------------------------- */
+static unsigned long mismatches(int verbose)
+{
+    volatile unsigned long count = 0;
+
+    current = 0;
+    if (sigsetjmp(fault_jump, 0))
+        faulted[current] = 1;
+    for (; current < NCASES; current++)
+    {
+        if (faulted[current])
+        {
+            strcpy(es_buf, "(fault)\n");
+        }
+        else
+        {
+            es_buf[0] = '\0';
+            cases[current].es(es_buf);
+        }
+        cases[current].lc(lc_buf);
+        if (strcmp(es_buf, lc_buf) != 0)
+        {
+            if (verbose && count < 10)
+                fprintf(stderr, "record %u:\n  es:   %s  libc: %s", current + 1, es_buf, lc_buf);
+            count++;
+        }
+    }
+    return count;
+}
+
+/* ---------------------------------------------------------------------------
+Function: run_trace()
+Run each record once, skipping those which have faulted, and return the
+number of calls made. If lat is given the latency of each call is stored
+there, otherwise the length of the output is added to bytes.
+--------------------------------------------------------------------------- */
+static unsigned long run_trace(int use_lc, unsigned long *lat, unsigned long overhead,
+                               unsigned long *bytes)
+{
+    static unsigned long calls;
+    unsigned long t0, t1;
+
+    calls = 0;
+    current = 0;
+    if (sigsetjmp(fault_jump, 0))
+    {
+        // A record may only fault in some runs, depending on what was
+        // left in the unused argument registers.
+        faulted[current++] = 1;
+    }
+    for (; current < NCASES; current++)
+    {
+        replay_fn fn = use_lc ? cases[current].lc : cases[current].es;
+
+        if (faulted[current])
+            continue;
+        if (lat)
+        {
+            t0 = host_ns();
+            fn(es_buf);
+            t1 = host_ns() - t0;
+            lat[calls] = (t1 > overhead) ? t1 - overhead : 0;
+        }
+        else
+        {
+            fn(es_buf);
+            *bytes += strlen(es_buf);
+        }
+        calls++;
+    }
+    return calls;
+}
+
+int main(int argc, char *argv[])
+{
+    struct sigaction sa;
+    const char *name = "es-printf";
+    unsigned long loops = 100;
+    unsigned long *lat;
+    unsigned long bytes = 0;
+    unsigned long overhead = ~0UL;
+    unsigned long t0, t1, total;
+    unsigned long n, loop, wrong = 0;
+    int use_lc = 0, verbose = 0;
+    unsigned i;
+    int arg;
+
+    for (arg = 1; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        if (strcmp(argv[arg], "-l") == 0) use_lc = 1, name = "libc";
+        else if (strcmp(argv[arg], "-v") == 0) verbose = 1;
+    }
+    if (arg < argc) name = argv[arg++];
+    if (arg < argc) loops = strtoul(argv[arg], 0, 10);
+    if (loops == 0) loops = 1;
+
+    // The handler jumps out, so the signal must not stay blocked.
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_fault;
+    sa.sa_flags = SA_NODEFER;
+    sigaction(SIGSEGV, &sa, NULL);
+    sigaction(SIGBUS, &sa, NULL);
+
+    if (!use_lc)
+        wrong = mismatches(verbose);
+
+    lat = malloc(loops * NCASES * sizeof(*lat));
+    if (lat == NULL)
+        return 1;
+
+    // Cost of reading the clock, taken off each latency.
+    for (i = 0; i < 1000; i++)
+    {
+        t0 = host_ns();
+        t1 = host_ns();
+        if (t1 - t0 < overhead) overhead = t1 - t0;
+    }
+
+    // Throughput, with the whole trace in one timed block.
+    n = 0;
+    t0 = host_ns();
+    for (loop = 0; loop < loops; loop++)
+        n += run_trace(use_lc, NULL, 0, &bytes);
+    total = host_ns() - t0;
+    if (total == 0) total = 1;
+
+    // Latency of each call.
+    n = 0;
+    for (loop = 0; loop < loops; loop++)
+        n += run_trace(use_lc, lat + n, overhead, NULL);
+    if (n == 0)
+        return 1;
+    qsort(lat, n, sizeof(*lat), cmp_ul);
+
+    printf("%s %.0f %.1f %lu %lu %lu %lu ", name,
+           (double) n * 1e9 / total, (double) bytes * 1e3 / total,
+           lat[n / 2], lat[n * 9 / 10], lat[n * 99 / 100], lat[n - 1]);
+    if (use_lc)
+        printf("-\n");
+    else
+        printf("%lu\n", wrong);
+    free(lat);
+    return 0;
+}
@@ -0,0 +1,81 @@
+#!/bin/sh
+#*************************************************************************
+# es-printf  -  configurable printf for embedded systems
+#
+# Trace replay benchmark. Builds replay.c for each feature set with the
+# calls from a trace file, runs it on the host and prints a table of the
+# throughput, latency percentiles and mismatches against the C library.
+#
+# https://github.com/skirridsystems/es-printf
+#
+#*************************************************************************
+# Copyright (c) 2006 - 2021 Skirrid Systems
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+# DEALINGS IN THE SOFTWARE.
+#*****************************************************************************/
+
+# The trace is a text file with one sprintf call per line, described in
+# trace_gen.c. If TRACE is not given a synthetic trace is generated, so the
+# benchmark can be run without a captured one, e.g.
+#   make replay TRACE=capture.txt SETS="LONG_INT FULL_FLOAT" VERBOSE=1
+#
+# Everything can be overridden from the environment or the make command line.
+
+TRACE=${TRACE:-}
+CALLS=${CALLS:-1000}
+SEED=${SEED:-1}
+SETS=${SETS:-"HEX_INT MINIMAL_INT BASIC_INT SHORT_INT LONG_INT LONG_LONG_INT FULL_INT FULL_FLOAT"}
+LOOPS=${LOOPS:-100}
+OPT=${OPT:--O2}
+HOST_GCC=${HOST_GCC:-gcc}
+VERBOSE=${VERBOSE:-}
+
+REPLAY_OUT=${REPLAY_OUT:-replay_out}
+CASES=$REPLAY_OUT/cases.h
+
+mkdir -p "$REPLAY_OUT"
+
+if [ -z "$TRACE" ]; then
+    TRACE=$REPLAY_OUT/trace.txt
+    $HOST_GCC -o "$REPLAY_OUT/trace_gen" trace_gen.c || exit 1
+    "$REPLAY_OUT/trace_gen" "$CALLS" "$SEED" > "$TRACE" || exit 1
+fi
+
+# One R(n, ...) line per call, skipping comments and blank lines.
+awk '/^[ \t]*(#|$)/ { next } { printf "R(%d, %s)\n", ++n, $0 }' "$TRACE" > "$CASES"
+echo "$(wc -l < "$CASES") calls from $TRACE, $LOOPS loops"
+
+opts=${VERBOSE:+-v}
+
+printf "\n%-14s %10s %8s %7s %7s %7s %8s %10s\n" \
+    set calls/s MB/s p50 p90 p99 "max ns" mismatches
+for set in $SETS; do
+    elf=$REPLAY_OUT/replay_$set
+    if $HOST_GCC $OPT -DFEATURE_FLAGS="$set" -DREPLAY_CASES="\"$CASES\"" -o "$elf" replay.c -lm; then
+        "$elf" $opts "$set" "$LOOPS"
+    else
+        echo "$set: build failed" >&2
+    fi
+done | awk '{ printf "%-14s %10s %8s %7s %7s %7s %8s %10s\n", $1, $2, $3, $4, $5, $6, $7, $8 }'
+
+# The library is the same for every set, so it is timed once.
+elf=$REPLAY_OUT/replay_libc
+if $HOST_GCC $OPT -DREPLAY_CASES="\"$CASES\"" -o "$elf" replay.c -lm; then
+    "$elf" -l libc "$LOOPS" | awk '{ printf "%-14s %10s %8s %7s %7s %7s %8s %10s\n", $1, $2, $3, $4, $5, $6, $7, $8 }'
+fi
@@ -79,9 +79,40 @@ DEALINGS IN THE SOFTWARE.
     // Force the same thing in our code to make comparison easier.
     #define EXP_3_DIGIT
     #define PUTCHAR_FUNC    testchar
+    #define PUTFILL_FUNC    testfill
+    // Test the DMA output using a simulated DMA channel.
+    #define PRINTF_DMA
+    // Test the resumable output a few chars at a time.
+    #define PRINTF_STEP
+    // Test output into a chain of small buffer fragments.
+    #define PRINTF_CHAIN
+    // Test the memory-mapped log where mmap is available.
+    #if defined(__unix__)
+        #define PRINTF_MMAP
+    #endif
+    // Test the sharded log with a clock which ticks on every record.
+    #define PRINTF_SHARD
+    #define PRINTF_SHARD_TIME()     (++shard_clock)
+    static unsigned long shard_clock;
+    // Test the CBOR binary output.
+    #define PRINTF_CBOR
+    // Test output to several sinks.
+    #define PRINTF_TEE
+    // Test level-filtered logging through the test output.
+    #define PRINTF_LOG
+    #define PRINTF_LOG_FUNC _prntf
+    // Read the format in small blocks as though from flash, stopping at the end.
+    #define GET_FORMAT_BLOCK(d, s, n)   testblock(d, s, n)
+    #define FORMAT_BLOCK    4
+    static void testblock(char *d, const char *s, unsigned n)
+    {
+        while (n-- && (*d++ = *s++) != '\0')
+            ;
+    }
 
     // Redefine our printf output function.
     static void testchar(char c);
+    static void testfill(char c, int n);
     void outinit(void) {}
 #endif
 
@@ -94,17 +125,21 @@ DEALINGS IN THE SOFTWARE.
 */
 #define printf x
 #define sprintf x
+#define sscanf x
+#define vsscanf x
 
 /* Include the printf source here so we can control the definitions
    used in the test environment. You would not normally need to do this.
 */
 #include "../src/printf.c"
+#include "../src/scanf.c"
 
 #if defined(TEST_AVR)
     /* In the AVR test environment define a new macro to use our function
        with strings in flash.
     */
     #define tprintf(format, args...)        _prntf(PSTR(format), ## args)
+    #define texpect(expect, format, args...) _prntf(PSTR(format), ## args)
   #ifdef BASIC_PRINTF_ONLY
     #define tsprintf(buf, format, args...)  _prntf(PSTR(format), ## args)
   #else
@@ -116,6 +151,7 @@ DEALINGS IN THE SOFTWARE.
        to the less flexible __VA_ARGS__ instead.
     */
     #define tprintf(...)                    _prntf(__VA_ARGS__)
+    #define texpect(expect, ...)            _prntf(__VA_ARGS__)
   #ifdef BASIC_PRINTF_ONLY
     #define tsprintf(buf, ...)              _prntf(__VA_ARGS__)
   #else
@@ -127,11 +163,20 @@ DEALINGS IN THE SOFTWARE.
     */
     #undef printf
     #undef sprintf
+    #undef sscanf
+    #undef vsscanf
     #define COMPARE_TEST
     #define tprintf(format, args...)        do { sprintf(stdbuf, format, ## args);  \
                                                  testinit();                        \
                                                  _prntf(format, ## args);       \
                                                  testcompare(); } while(0)
+    /* Extensions which the library version does not support are compared
+       against the expected output instead.
+    */
+    #define texpect(expect, format, args...) do { strcpy(stdbuf, expect);         \
+                                                 testinit();                        \
+                                                 _prntf(format, ## args);       \
+                                                 testcompare(); } while(0)
   #ifdef BASIC_PRINTF_ONLY
     #define tsprintf(buf, format, args...)  do { sprintf(stdbuf, format, ## args);  \
                                                  testinit();                        \
@@ -186,6 +231,11 @@ void testchar(char c)
         testbuf[testindex] = '\0';
     }
 }
+void testfill(char c, int n)
+{
+    while (n--)
+        testchar(c);
+}
 void testcompare(void)
 {
     if (strcmp(stdbuf, testbuf) == 0)
@@ -200,6 +250,143 @@ void testcompare(void)
 }
 #endif
 
+#if defined(COMPARE_TEST) && defined(PRINTF_DMA) && !defined(BASIC_PRINTF_ONLY) && FEATURE(USE_STRING)
+/* Simulated DMA channel with small buffers so they are swapped often.
+   A transfer is only copied to the output when printf waits for it or the
+   test completes it, in the same way as a real transfer finishes later.
+*/
+static struct printf_dma dma;
+static char dma_buf[2][8];
+static const char *dma_data;
+static unsigned dma_len;
+
+static void sim_dma_start(const char *data, unsigned len, void *user)
+{
+    (void) user;
+    dma_data = data;
+    dma_len = len;
+}
+
+static void sim_dma_complete(void *user)
+{
+    (void) user;
+    while (dma_len)
+    {
+        testchar(*dma_data++);
+        --dma_len;
+    }
+    printf_dma_done(&dma);
+}
+#endif
+
+#if defined(COMPARE_TEST) && defined(PRINTF_TEE) && !defined(BASIC_PRINTF_ONLY) && FEATURE(USE_STRING) && FEATURE(USE_LEFT_JUST)
+/* Sinks for the tee test: the test output with a fill function, and a
+   buffer with the position in the context.
+*/
+static void tee_char(char c, void *context)
+{
+    (void) context;
+    testchar(c);
+}
+
+static void tee_fill(char c, int n, void *context)
+{
+    (void) context;
+    testfill(c, n);
+}
+
+static void tee_buf(char c, void *context)
+{
+    *(*(char **) context)++ = c;
+}
+#endif
+
+#if defined(COMPARE_TEST) && defined(PRINTF_STEP) && !defined(BASIC_PRINTF_ONLY)
+/* Output using printf_step() with a small space each time, so that
+   literal text and conversions are split across steps.
+*/
+static void step_printf(const char *fmt, ...)
+{
+    struct printf_step step;
+    va_list ap;
+    char out[3];
+    int i, n;
+
+    va_start(ap, fmt);
+    printf_step_init(&step, fmt, &ap);
+    do
+    {
+        n = printf_step(&step, out, sizeof(out));
+        for (i = 0; i < n; i++)
+            testchar(out[i]);
+    } while (n == sizeof(out));
+    va_end(ap);
+}
+
+#define tstep(format, args...)  do { sprintf(stdbuf, format, ## args);  \
+                                     testinit();                        \
+                                     step_printf(format, ## args);      \
+                                     testcompare(); } while(0)
+#endif
+
+#ifdef COMPARE_TEST
+/* Scan two values with the library and our own sscanf. The count and the
+   values are printed with the given format so that they can be compared.
+*/
+#define tscanf(type, input, format, pformat)                                \
+    do { type a1 = 0, b1 = 0, a2 = 0, b2 = 0;                              \
+         int n1 = sscanf(input, format, &a1, &b1);                         \
+         int n2 = _sscnf(input, format, &a2, &b2);                         \
+         sprintf(stdbuf, "Scan %d " pformat " " pformat "\n", n1, a1, b1);  \
+         sprintf(testbuf, "Scan %d " pformat " " pformat "\n", n2, a2, b2); \
+         testcompare(); } while(0)
+#endif
+
+#if FEATURE(USE_CUSTOM)
+/* Custom conversion for an IPv4 address held in an unsigned long.
+   The text is formatted into the buffer provided.
+*/
+static const char *conv_ip(struct printf_spec *spec, va_list *ap, char *buf, int size)
+{
+    unsigned long ip = va_arg(*ap, unsigned long);
+    char *p = buf + size;
+    unsigned char i, n;
+
+    (void) spec;
+    *--p = '\0';
+    // Fill the buffer backwards, starting with the last octet.
+    for (i = 0; i < 4; i++)
+    {
+        n = (ip >> 24) & 0xff;
+        do *--p = n % 10 + '0';
+        while ((n /= 10) != 0);
+        if (i < 3) *--p = '.';
+        ip <<= 8;
+    }
+    return p;
+}
+
+/* Custom conversion for a boolean, returning a constant string.
+   The # flag selects the long form, and l or ll the type of the value.
+*/
+static const char *conv_bool(struct printf_spec *spec, va_list *ap, char *buf, int size)
+{
+    int value;
+
+    if (spec->flags & PRINTF_LONG_LONG)
+        value = va_arg(*ap, long long) != 0;
+    else if (spec->flags & PRINTF_LONG)
+        value = va_arg(*ap, long) != 0;
+    else
+        value = va_arg(*ap, int);
+    (void) buf;
+    (void) size;
+    if (spec->flags & PRINTF_SPECIAL)
+        return value ? "true" : "false";
+    return value ? "Y" : "N";
+}
+#endif
+
 int main(int argc, char *argv[])
 {
 #ifndef BASIC_PRINTF_ONLY
@@ -236,6 +423,19 @@ int main(int argc, char *argv[])
   #if FEATURE(USE_HEX_UPPER) || FEATURE(USE_HEX_LOWER)
     tprintf("Hex %x %4x %018X %+x % x %-4x. %+#x\n", X, X, X, X, X, X, X);
   #endif
+  #if FEATURE(USE_INT128) && defined(COMPARE_TEST)
+    texpect("W128 340282366920938463463374607431768211455 -170141183460469231731687303715884105728 -5 [  7]\n",
+            "W128 %w128u %w128d %w128d [%3w128d]\n", ~(unsigned __int128) 0, (__int128) ((unsigned __int128) 1 << 127),
+            (__int128) -5, (__int128) 7);
+    #if FEATURE(USE_HEX_LOWER) && FEATURE(USE_OCTAL) && FEATURE(USE_SPECIAL) && FEATURE(USE_PRECISION)
+    texpect("W128 184467440737095516160000000000000000005 0x8ac7230489e800000000000000000005 02126162140442364000000000000000000000000005 007\n",
+            "W128 %w128u %#w128x %#w128o %.3w128u\n", (unsigned __int128) 10000000000000000000ULL << 64 | 5,
+            (unsigned __int128) 10000000000000000000ULL << 64 | 5, (unsigned __int128) 10000000000000000000ULL << 64 | 5,
+            (unsigned __int128) 7);
+    #endif
+    texpect("W64 -9223372036854775807 [-5] 4294967295 w16d w8u\n",
+            "W64 %w64d [%w32d] %w32u %w16d %w8u\n", -9223372036854775807LL, -5, 4294967295U);
+  #endif
   #if FEATURE(USE_OCTAL)
     tprintf("Oct %o %4o %04o %+o % o %-4o. %+#o\n", O, O, O, O, O, O, O);
   #endif
@@ -245,7 +445,8 @@ int main(int argc, char *argv[])
     tprintf("B32 %lb %032lb\n", B32, B32);
     #endif
     #if FEATURE(USE_LONG_LONG)
-    tprintf("B64 %llb %032llb\n", B64, B64);
+    // Binary is limited to the low 32 bits.
+    texpect("B64 111001100100110001000100010001 00111001100100110001000100010001\n", "B64 %llb %032llb\n", B64, B64);
     #endif
   #endif
   #if FEATURE(USE_STRING)
@@ -256,6 +457,11 @@ int main(int argc, char *argv[])
   #endif
   #if FEATURE(USE_PRECISION)
     tprintf("Prec %.d %.2d %.2d %.2d %-5.3s %.3s.\n", 0, 1, 0, -1, S, S);
+    tprintf("Prec [%8.3s] [%2.3s] [%8.0s]\n", S, S, S);
+  #endif
+  #if FEATURE(USE_STRING) && FEATURE(USE_SIGNED) && FEATURE(USE_LEFT_JUST)
+    // Wide fields as used in tables.
+    tsprintf(testbuf, "Table [%-40s] [%20d]\n", S, N);
   #endif
 #else
   // Simpler tests for variants with no padding options.
@@ -274,6 +480,90 @@ int main(int argc, char *argv[])
   #endif
 #endif
 
+// Strings longer than width_t can hold are output and counted in full.
+#if defined(COMPARE_TEST) && defined(PRINTF_T) && !defined(BASIC_PRINTF_ONLY) && !defined(PRINTF_WCET) && FEATURE(USE_STRING)
+    {
+        static char lstr[301];
+        static char lbuf[500];
+        unsigned n;
+
+        memset(lstr, 'x', sizeof(lstr) - 1);
+        n = _sprntf(lbuf, "%s|", lstr);
+        strcpy(stdbuf, "Long 301 301\n");
+        sprintf(testbuf, "Long %u %u\n", n, (unsigned) strlen(lbuf));
+        testcompare();
+  #if FEATURE(USE_SPACE_PAD) && FEATURE(USE_LEFT_JUST)
+        // A width less than the length gives no padding.
+        n = _sprntf(lbuf, "%5s|%-5s|", lstr + 100, lstr + 100);
+        strcpy(stdbuf, "Long 402 402\n");
+        sprintf(testbuf, "Long %u %u\n", n, (unsigned) strlen(lbuf));
+        testcompare();
+  #endif
+    }
+#endif
+
+// Custom conversions.
+#if FEATURE(USE_CUSTOM)
+    printf_register('I', conv_ip);
+    printf_register('B', conv_bool);
+  #if FEATURE(USE_SPACE_PAD) && FEATURE(USE_LEFT_JUST) && FEATURE(USE_SPECIAL)
+    texpect("Cust [192.168.1.10] [    10.0.0.1] [10.0.0.1    ] [N] [true ] -23\n",
+            "Cust [%I] [%12I] [%-12I] [%B] [%#-5B] %d\n", 0x0A01A8C0UL, 0x0100000AUL, 0x0100000AUL, 0, 1, N);
+  #else
+    texpect("Cust [192.168.1.10] [N]\n", "Cust [%I] [%B]\n", 0x0A01A8C0UL, 0);
+  #endif
+  #if FEATURE(USE_LONG_LONG)
+    texpect("Cust [Y] [N] [Y]\n", "Cust [%llB] [%B] [%lB]\n", 1LL << 32, 0, 1L);
+  #endif
+  #if FEATURE(USE_SIGNED)
+    // Built-in letters and the chars taken by the parser cannot be registered.
+    strcpy(stdbuf, "Cust -1 -1 -1 0\n");
+    sprintf(testbuf, "Cust %d %d %d %d\n", printf_register('d', conv_bool), printf_register('l', conv_bool),
+            printf_register('%', conv_bool), printf_register('B', conv_bool));
+    testcompare();
+  #endif
+#endif
+
+// Timestamps. Consecutive calls use the cached date and time.
+#if FEATURE(USE_TIMESTAMP)
+    {
+        struct printf_time tc = { 1 };
+
+        texpect("Time 2024-02-29T23:59:59 2024-02-29T23:59:59\n", "Time %T %T\n", &tc, 1709251199UL, &tc, 1709251199UL);
+        texpect("Time 2024-03-01T00:00:00 2100-03-01T00:00:00\n", "Time %T %T\n", &tc, 1709251200UL, &tc, 4107542400UL);
+  #if FEATURE(USE_LONG_LONG)
+        tc.rate = 1000;
+        tc.text[0] = '\0';
+        texpect("Time 2026-10-19T12:34:56.789 2026-10-19T12:34:57.0 2026-10-19T12:35:00\n", "Time %.3llT %.1llT %llT\n",
+                &tc, 1792413296789ULL, &tc, 1792413297001ULL, &tc, 1792413300000ULL);
+        tc.rate = 1000000000UL;
+        texpect("Time 2026-10-19T12:35:00.987654321\n", "Time %.9llT\n", &tc, 1792413300987654321ULL);
+  #endif
+  #if FEATURE(USE_PRECISION)
+        // The fraction must not overflow for the largest rate, nor divide by a rate of zero.
+        tc.rate = ~0UL;
+        tc.text[0] = '\0';
+        texpect("Time 1970-01-01T00:00:00.999999999\n", "Time %.9T\n", &tc, ~0UL - 1);
+  #endif
+        tc.rate = 0;
+        texpect("Time ?\n", "Time %T\n", &tc, 1UL);
+  #if FEATURE(USE_SPACE_PAD)
+        tc.rate = 1;
+        texpect("Time [  2026-10-19T12:35:00]\n", "Time [%21T]\n", &tc, 1792413300UL);
+  #endif
+    }
+#endif
+
+// JSON and CSV escaping. Width and precision count the escaped text.
+#if FEATURE(USE_ESCAPE)
+    texpect("Escape {\"m\":\"a\\\"b\\\\c\\n\\u001f\"} \"x,\"\"y\"\"\"\n",
+            "Escape {\"m\":\"%J\"} %Q\n", "a\"b\\c\n\x1f", "x,\"y\"");
+  #if FEATURE(USE_SPACE_PAD) && FEATURE(USE_LEFT_JUST) && FEATURE(USE_PRECISION)
+    texpect("Escape [   \"a\"\"\"] [a\\\"  ] [ab\\\"] [\"abc\"]\n",
+            "Escape [%8Q] [%-5J] [%.4J] [%.3Q]\n", "a\"", "a\"", "ab\"cd", "abcd");
+  #endif
+#endif
+
 // Floating point output.
 #if FEATURE(USE_FLOAT)
     tprintf("pi = %f %e %g\n", PI, PI, PI);
@@ -299,16 +589,421 @@ int main(int argc, char *argv[])
     tprintf("just = %-8.4f %-12.2e %-8.4g\n", PI, PI, PI);
 #endif
     tprintf("Lead = %.26f\n", 7e-30);
+    tprintf("Carry = %e %.0f %.1f %.2g %.0e\n", 9.9999999, 9.7, 99.96, 9.99, 9.7);
+#if FEATURE(USE_FAST_NORM) && !defined(NO_DOUBLE_PRECISION)
+    // Powers of ten and denormals around the limits of the scale tables.
+    tprintf("Norm = %e %e %e %e %e\n", 1e23, 9.9999999e22, 1e-300, 5e-324, 1.5e-310);
+#endif
+#if FEATURE(USE_EXACT_FLOAT)
+    tprintf("Exact = %.30f %f %.0f %.1f\n", 0.1, 1e30, 2.5, 0.25);
+    // The largest precision that fits in width_t.
+    tprintf("Exact = %.127f\n", 1e-100);
+#endif
 #if FEATURE(USE_ZERO_PAD)
     tprintf("zpad = %+09.4f %+012.2e %+09.4g\n", PI, PI, PI);
     tprintf("zmax = %+030.4f\n", PI);
 #endif
 #endif
 
+// Hexadecimal floating point output.
+#if FEATURE(USE_HEX_FLOAT)
+    tprintf("Hexf = %a %A %a %a\n", PI, PI, 0.0, -0.1);
+  #if FEATURE(USE_PRECISION) || FEATURE(USE_FLOAT)
+    tprintf("Hexf = %.1a %.0a %.3a\n", 1.96875, 1.5, PI);
+    tprintf("Hexf = %.19a\n", 1.5);
+    // Precision beyond BUFMAX - 11 digits is capped.
+    sprintf(stdbuf, "Hexf = %.*a\n", DIGITS_MAX_A, 1.5);
+    _sprntf(testbuf, "Hexf = %.40a\n", 1.5);
+    testcompare();
+  #endif
+  #if FEATURE(USE_SPACE_PAD) && FEATURE(USE_ZERO_PAD) && FEATURE(USE_LEFT_JUST)
+    tprintf("Hexf = [%14.3a] [%-14.3a] [%014.3a]\n", PI, PI, -PI);
+  #endif
+#endif
+
+// Instrumentation counts for a single call.
+#if FEATURE(USE_STATS) && FEATURE(USE_SIGNED) && FEATURE(USE_STRING)
+    {
+        struct printf_stat st[PRINTF_STAT_MAX];
+        printf_stats_reset();
+        tprintf("Stats %d %s\n", N, S);
+        printf_stats_snapshot(st);
+        texpect("Stats 1 16 1 3 1 5\n", "Stats %d %d %d %d %d %d\n",
+            (int) st[PRINTF_STAT_CALL].calls, (int) st[PRINTF_STAT_CALL].bytes,
+            (int) st[PRINTF_STAT_INT].calls, (int) st[PRINTF_STAT_INT].bytes,
+            (int) st[PRINTF_STAT_STRING].calls, (int) st[PRINTF_STAT_STRING].bytes);
+    }
+#endif
+
+// Resumable output a few chars at a time.
+#if defined(COMPARE_TEST) && defined(PRINTF_STEP) && !defined(BASIC_PRINTF_ONLY)
+    tstep("Step %x %% text\n", X);
+  #if FEATURE(USE_SIGNED) && FEATURE(USE_STRING)
+    tstep("Step %d [%s] %d\n", N, S, 12345);
+  #endif
+  #if FEATURE(USE_SPACE_PAD) && FEATURE(USE_ZERO_PAD) && FEATURE(USE_LEFT_JUST) && FEATURE(USE_SIGNED)
+    tstep("Step [%5d] [%-5d] [%05d]\n", N, N, N);
+  #endif
+  #if FEATURE(USE_SPACE_PAD) && FEATURE(USE_LEFT_JUST) && FEATURE(USE_PRECISION) && FEATURE(USE_STRING)
+    tstep("Step [%8s] [%-8s] [%.3s] [%-8.3s]\n", S, S, S, S);
+    tstep("Step [%8.3s] [%5.2s] [%2.3s]\n", S, "xyz", S);
+  #endif
+  #if FEATURE(USE_FLOAT)
+    tstep("Step %f %e %g\n", PI, FL, F6);
+  #endif
+  #if FEATURE(USE_ESCAPE)
+    // Escaped text longer than the step buffer is output in pieces.
+    _sprntf(stdbuf, "Step %Q [%J]\n", "a\"b,\x01" "0123456789012345678901234567890123456789", "\\\n");
+    testinit();
+    step_printf("Step %Q [%J]\n", "a\"b,\x01" "0123456789012345678901234567890123456789", "\\\n");
+    testcompare();
+    #if FEATURE(USE_SPACE_PAD) && FEATURE(USE_LEFT_JUST) && FEATURE(USE_PRECISION)
+    _sprntf(stdbuf, "Step [%8Q] [%-5J] [%.4J] [%.3Q]\n", "a\"", "a\"", "ab\"cd", "abcd");
+    testinit();
+    step_printf("Step [%8Q] [%-5J] [%.4J] [%.3Q]\n", "a\"", "a\"", "ab\"cd", "abcd");
+    testcompare();
+    #endif
+  #endif
+#endif
+
+// Double-buffered DMA output through the simulated channel.
+#if defined(COMPARE_TEST) && defined(PRINTF_DMA) && !defined(BASIC_PRINTF_ONLY) && FEATURE(USE_STRING)
+    printf_dma_init(&dma, dma_buf[0], dma_buf[1], sizeof(dma_buf[0]), sim_dma_start, sim_dma_complete, 0);
+    sprintf(stdbuf, "DMA [%s] [%s]\n", S, "ABCDEFGHIJKLMNOPQRSTUVWXYZ");
+    testinit();
+    printf_dma(&dma, "DMA [%s] ", S);
+    sim_dma_complete(0);    // Interrupt between calls starts the waiting text.
+    printf_dma(&dma, "[%s]\n", "ABCDEFGHIJKLMNOPQRSTUVWXYZ");
+    printf_dma_flush(&dma);
+    testcompare();
+#endif
+
+// Buffer chain output split across fragments of different sizes.
+#if defined(COMPARE_TEST) && defined(PRINTF_CHAIN) && !defined(BASIC_PRINTF_ONLY) && FEATURE(USE_SIGNED)
+    {
+        static char fbuf[4][10];
+        struct printf_frag frag[4] = {
+            { fbuf[0], 5, 0, &frag[1] },
+            { fbuf[1], 0, 0, &frag[2] },
+            { fbuf[2], 3, 0, &frag[3] },
+            { fbuf[3], 10, 0, 0 },
+        };
+        struct printf_frag *f;
+        unsigned i;
+
+        sprintf(stdbuf, "Chain %d,%d.\n", -12345, 678);
+        testinit();
+        printf_chain(frag, "Chain %d,", -12345);
+        printf_chain(frag, "%d.\n", 678);
+        for (f = frag; f; f = f->next)
+            for (i = 0; i < f->len; i++)
+                testchar(f->data[i]);
+        testcompare();
+        // The chain is full, so further output is dropped.
+        printf_chain(frag, "More");
+        texpect("Chain 5 0 3 10\n", "Chain %d %d %d %d\n", (int) frag[0].len, (int) frag[1].len, (int) frag[2].len, (int) frag[3].len);
+    }
+#endif
+
+// Memory-mapped log with a small limit and extent, so it grows and fills.
+#if defined(COMPARE_TEST) && defined(PRINTF_MMAP) && !defined(BASIC_PRINTF_ONLY) && FEATURE(USE_SIGNED) && FEATURE(USE_STRING)
+    {
+        static struct printf_mmap mlog;
+        FILE *f;
+        size_t n = 0;
+        size_t expect;
+        int dropped = -1;
+
+        remove("mmap_test.log");
+        sprintf(stdbuf, "MMAP %d [%s] %d [%s]\n", N, S, 2, "reopened");
+        expect = strlen(stdbuf);
+        testinit();
+        if (printf_mmap_open(&mlog, "mmap_test.log", 40, 16) == 0)
+        {
+            printf_mmap(&mlog, "MMAP %d [%s] ", N, S);
+            printf_mmap_close(&mlog);
+        }
+        if (printf_mmap_open(&mlog, "mmap_test.log", 40, 16) == 0)
+        {
+            printf_mmap(&mlog, "%d [%s]\n", 2, "reopened");
+            // Past the limit, so it is dropped.
+            printf_mmap(&mlog, "MMAP %d more\n", 3);
+            dropped = (int) mlog.dropped;
+            printf_mmap_close(&mlog);
+        }
+        f = fopen("mmap_test.log", "rb");
+        if (f)
+        {
+            n = fread(testbuf, 1, sizeof(testbuf) - 1, f);
+            testbuf[n] = '\0';
+            fclose(f);
+            remove("mmap_test.log");
+        }
+        testcompare();
+        // The file ends at the last record, with no space left by the dropped one.
+        sprintf(stdbuf, "MMAP dropped 1 size %u\n", (unsigned) expect);
+        sprintf(testbuf, "MMAP dropped %d size %u\n", dropped, (unsigned) n);
+        testcompare();
+    }
+#endif
+
+// Sharded log buffers merged in time stamp order.
+#if defined(COMPARE_TEST) && defined(PRINTF_SHARD) && !defined(BASIC_PRINTF_ONLY) && FEATURE(USE_SIGNED) && FEATURE(USE_STRING)
+    {
+        static char sbuf[2][48];
+        static struct printf_shard shard[2];
+        unsigned sent;
+
+        printf_shard_init(&shard[0], sbuf[0], sizeof(sbuf[0]));
+        printf_shard_init(&shard[1], sbuf[1], sizeof(sbuf[1]));
+        sprintf(stdbuf, "Shard %d [%s] %d %s\n", N, S, 3, "done");
+        testinit();
+        printf_shard(&shard[1], "Shard ");
+        printf_shard(&shard[0], "%d ", N);
+        printf_shard(&shard[0], "[%s] ", S);
+        // Too long for the space left, so it is dropped.
+        printf_shard(&shard[0], "%s %s %s %s", S, S, S, S);
+        printf_shard(&shard[1], "%d ", 3);
+        printf_shard(&shard[0], "%s\n", "done");
+        sent = printf_shard_drain(shard, 2, 0, testchar);
+        testcompare();
+        texpect("Shard 5 1 0\n", "Shard %u %d %d\n", sent, (int) shard[0].dropped, (int) shard[1].dropped);
+        // The rings wrap once the space has been freed.
+        sprintf(stdbuf, "Shard wrap [%s] [%s]\n", S, S);
+        testinit();
+        printf_shard(&shard[0], "Shard wrap [%s] ", S);
+        printf_shard(&shard[0], "[%s]\n", S);
+        printf_shard_drain(shard, 2, 1, testchar);
+        printf_shard_drain(shard, 2, 1, testchar);
+        testcompare();
+    }
+#endif
+
+// CBOR output, compared as hex bytes.
+#if defined(COMPARE_TEST) && defined(PRINTF_CBOR) && !defined(BASIC_PRINTF_ONLY) && FEATURE(USE_SIGNED) && FEATURE(USE_STRING)
+    {
+        unsigned char cbuf[40];
+        unsigned i, n;
+
+        n = printf_cbor(cbuf, sizeof(cbuf), "T=%d V=%u %s %%\n", N, 300, S);
+        strcpy(stdbuf, "CBOR bf615436615619012c02454162636465ff 17\n");
+        for (i = 0; i < n && i < sizeof(cbuf); i++)
+            sprintf(testbuf + 2 * i, "%02x", cbuf[i]);
+        sprintf(testbuf + 2 * i, " %u\n", n);
+        memmove(testbuf + 5, testbuf, strlen(testbuf) + 1);
+        memcpy(testbuf, "CBOR ", 5);
+        testcompare();
+  #if FEATURE(USE_FLOAT)
+        n = printf_cbor(cbuf, sizeof(cbuf), "%.1f %f %g", 1.5, 0.1, 1e10);
+        strcpy(stdbuf, "CBOR bf00f93e0001fb3fb999999999999a02fa501502f9ff 22\n");
+        for (i = 0; i < n && i < sizeof(cbuf); i++)
+            sprintf(testbuf + 2 * i, "%02x", cbuf[i]);
+        sprintf(testbuf + 2 * i, " %u\n", n);
+        memmove(testbuf + 5, testbuf, strlen(testbuf) + 1);
+        memcpy(testbuf, "CBOR ", 5);
+        testcompare();
+  #endif
+  #if FEATURE(USE_HEX_FLOAT)
+        n = printf_cbor(cbuf, sizeof(cbuf), "%a %A", 1.5, 0.1);
+        strcpy(stdbuf, "CBOR bf00f93e0001fb3fb999999999999aff 16\n");
+        for (i = 0; i < n && i < sizeof(cbuf); i++)
+            sprintf(testbuf + 2 * i, "%02x", cbuf[i]);
+        sprintf(testbuf + 2 * i, " %u\n", n);
+        memmove(testbuf + 5, testbuf, strlen(testbuf) + 1);
+        memcpy(testbuf, "CBOR ", 5);
+        testcompare();
+  #endif
+    }
+#endif
+
+// Output to several sinks, one with a fill function and one without.
+#if defined(COMPARE_TEST) && defined(PRINTF_TEE) && !defined(BASIC_PRINTF_ONLY) && FEATURE(USE_STRING) && FEATURE(USE_LEFT_JUST)
+    {
+        static char tbuf[100];
+        static char *tpos;
+        static const struct printf_sink sinks[2] = {
+            { tee_char, tee_fill, 0 },
+            { tee_buf, 0, &tpos }
+        };
+        struct printf_tee tee = { sinks, 2, ~0U };
+
+        tpos = tbuf;
+        testinit();
+        printf_tee(&tee, "Tee [%8s] [%-6s]", S, "x");
+        tee.enable = 2;
+        printf_tee(&tee, " off");
+        tee.enable = 1;
+        printf_tee(&tee, " on\n");
+        *tpos = '\0';
+        strcpy(stdbuf, "Tee [   Abcde] [x     ] on\n");
+        testcompare();
+        strcpy(stdbuf, "Tee [   Abcde] [x     ] off\n");
+        sprintf(testbuf, "%s\n", tbuf);
+        testcompare();
+    }
+#endif
+
+// Logging levels removed at compile time or turned off for a module do not evaluate their arguments.
+#if defined(COMPARE_TEST) && defined(PRINTF_LOG) && FEATURE(USE_SIGNED)
+    {
+        int n = 0;
+
+        strcpy(stdbuf, "Log 1 2 0 3\n");
+        testinit();
+        printf_log_mute[1] = 1 << PRINTF_LOG_DEBUG;
+        printf_log(0, PRINTF_LOG_DEBUG, "Log %d", ++n);
+        printf_log(1, PRINTF_LOG_DEBUG, " x%d", ++n);
+        printf_log(1, PRINTF_LOG_WARN, " %d", ++n);
+        printf_log(0, PRINTF_LOG_TRACE, " x%d", ++n);
+        printf_log(0, PRINTF_LOG_ERROR, " %d", printf_log_mute[0]);
+        printf_log(1, PRINTF_LOG_ERROR, " %d\n", ++n);
+        printf_log_mute[1] = 0;
+        testcompare();
+    }
+#endif
+
+// Worst case arguments with PRINTF_WCET. The length and steps are only shown if over the limit.
+#if defined(COMPARE_TEST) && defined(PRINTF_WCET) && !defined(BASIC_PRINTF_ONLY)
+    {
+        static char big[200], ctl[200];
+        char wbuf[400];
+        unsigned len, steps;
+
+  #define twcet(limit, slimit, format, arg) do { printf_wcet_steps = 0;                                   \
+                                         _sprntf(wbuf, format, arg);                                      \
+                                         len = strlen(wbuf);                                              \
+                                         if (len < (limit)) len = (limit);                                \
+                                         steps = (unsigned) printf_wcet_steps;                            \
+                                         if (steps < (slimit)) steps = (slimit);                          \
+                                         sprintf(stdbuf, "WCET %s %u %u\n", format, (limit), (slimit));   \
+                                         sprintf(testbuf, "WCET %s %u %u\n", format, len, steps);         \
+                                         testcompare(); } while(0)
+        memset(big, 'x', sizeof(big) - 1);
+        memset(ctl, '\x01', sizeof(ctl) - 1);
+  // Most steps taken to normalise a double, as given in the documentation.
+  #if FEATURE(USE_SMALL_FLOAT)
+    #define WCET_NORM   55
+  #elif FEATURE(USE_FAST_NORM)
+    #define WCET_NORM   5
+  #else
+    #define WCET_NORM   19
+  #endif
+  #if FEATURE(USE_STRING)
+        twcet(PRINTF_WCET_CHARS, PRINTF_WCET_CHARS, "%s", big);
+        twcet(PRINTF_WCET_CHARS, PRINTF_WCET_CHARS, "%-127.127s", big);
+  #endif
+  #if FEATURE(USE_ESCAPE)
+        twcet(PRINTF_WCET_CHARS + 2, PRINTF_WCET_CHARS + 2, "%Q", big);
+        twcet(PRINTF_WCET_CHARS + 2, PRINTF_WCET_CHARS + 2, "%J", ctl);
+        twcet(PRINTF_WCET_CHARS + 2, PRINTF_WCET_CHARS + 2, "%-127J", ctl);
+  #endif
+  #if FEATURE(USE_CHAR)
+        twcet(1, 1, "%127c", 'x');
+  #endif
+  #if FEATURE(USE_SIGNED) && FEATURE(USE_SPACE_PAD) && FEATURE(USE_PRECISION)
+        twcet(PRINTF_WCET_CHARS, PRINTF_WCET_CHARS, "%127d", -1);
+        twcet(BUFMAX, BUFMAX, "%.127d", -1);
+        twcet(PRINTF_WCET_CHARS, PRINTF_WCET_CHARS, "%-127.127d", -1);
+  #endif
+  #if FEATURE(USE_INT128) && FEATURE(USE_SPACE_PAD) && FEATURE(USE_PRECISION)
+        twcet(PRINTF_WCET_CHARS, PRINTF_WCET_CHARS, "%-127.127w128d", (__int128) ((unsigned __int128) 1 << 127));
+  #endif
+  #if FEATURE(USE_FLOAT) && FEATURE(USE_SPACE_PAD)
+        twcet(PRINTF_WCET_CHARS, PRINTF_WCET_CHARS + WCET_NORM, "%127.127e", -DBL_MAX);
+        twcet(PRINTF_WCET_CHARS, PRINTF_WCET_CHARS + WCET_NORM, "%127.127e", 4.9e-324);
+        twcet(PRINTF_WCET_CHARS + 2, PRINTF_WCET_CHARS + 2 + WCET_NORM, "%.127f", 4.9e-324);
+    #if FEATURE(USE_EXACT_FLOAT)
+        twcet(PRINTF_WCET_CHARS + 311, PRINTF_WCET_CHARS + 311, "%.127f", -DBL_MAX);
+    #else
+        twcet(PRINTF_WCET_CHARS + 2, PRINTF_WCET_CHARS + 2 + WCET_NORM, "%.127f", -DBL_MAX);
+    #endif
+        twcet(PRINTF_WCET_CHARS, PRINTF_WCET_CHARS + WCET_NORM, "%127.127g", 4.9e-324);
+        twcet(PRINTF_WCET_CHARS, PRINTF_WCET_CHARS + WCET_NORM, "%127.127g", -1.2345678901234567e-300);
+  #endif
+  #if FEATURE(USE_HEX_FLOAT) && FEATURE(USE_SPACE_PAD)
+        twcet(PRINTF_WCET_CHARS, PRINTF_WCET_CHARS, "%127.127a", -DBL_MAX);
+        twcet(PRINTF_WCET_CHARS, PRINTF_WCET_CHARS, "%127.127a", 4.9e-324);
+  #endif
+  #undef twcet
+  #undef WCET_NORM
+    }
+  #if FEATURE(USE_FLOAT) && !defined(NO_DOUBLE_PRECISION)
+    tprintf("Denormal = %e %g\n", 4.9e-324, 2.2250738585072e-308);
+  #endif
+#endif
+
+// Input with the companion sscanf, using the same feature flags.
+#ifdef COMPARE_TEST
+  #if FEATURE(USE_SIGNED)
+    tscanf(int, " -123  +456", "%d %d", "%d");
+    tscanf(int, "12,x", "%d,%d", "%d");
+    tscanf(int, "", "%d %d", "%d");
+    tscanf(short, "-7 32767", "%hd %hd", "%d");
+    tscanf(int, "1234567", "%3d%d", "%d");
+  #endif
+  #if FEATURE(USE_UNSIGNED)
+    tscanf(unsigned, "4000000000 %5", "%u %%%u", "%u");
+    tscanf(unsigned char, "255 17", "%hhu %hhu", "%u");
+  #endif
+  #if FEATURE(USE_HEX_LOWER)
+    tscanf(unsigned, "ff 0x1A2b", "%x %x", "%x");
+  #endif
+  #if FEATURE(USE_SIGNED_I)
+    tscanf(int, "0x1f -017", "%i %i", "%d");
+  #endif
+  #if FEATURE(USE_OCTAL)
+    tscanf(unsigned, "777 0129", "%o %o", "%o");
+    tscanf(unsigned, "0x1f", "%o%o", "%o");
+  #endif
+  #if FEATURE(USE_LONG) && FEATURE(USE_SIGNED)
+    tscanf(long, "-2147483647 99", "%ld %ld", "%ld");
+  #endif
+  #if FEATURE(USE_LONG_LONG) && FEATURE(USE_SIGNED) && FEATURE(USE_HEX_LOWER)
+    tscanf(long long, "-1234567890123456789 ffffffffffffffff", "%lld %llx", "%lld");
+  #endif
+  #if FEATURE(USE_INDIRECT) && FEATURE(USE_SIGNED)
+    tscanf(int, "1 2 3", "%*d %d %d", "%d");
+  #endif
+  #if FEATURE(USE_FLOAT)
+    tscanf(double, "3.25 -1.5e-3", "%lf %lf", "%g");
+    tscanf(double, "123456789012345678901234 .000000000000000000000123", "%lf %lf", "%.15g");
+    tscanf(float, "1e10 +.5E1", "%f %e", "%g");
+  #ifndef NO_DOUBLE_PRECISION
+    // DBL_MIN, a denormal, and exponents beyond the range of a double.
+    tscanf(double, "2.2250738585072014e-308 1e-310", "%lf %lf", "%.17g");
+    tscanf(double, "123456789012345678901234567890e-600 1e400", "%lf %lf", "%g");
+    tscanf(double, "1.7976931348623157e308 4.9e-324", "%lf %lf", "%.17g");
+  #endif
+  #endif
+  #if FEATURE(USE_BINARY)
+    {
+        unsigned a = 0, b = 0;
+        int n = _sscnf("110101 0101101010100101", "%b %b", &a, &b);
+        sprintf(stdbuf, "Scan 2 35 5aa5\n");
+        sprintf(testbuf, "Scan %d %x %x\n", n, a, b);
+        testcompare();
+    }
+  #endif
+  #if FEATURE(USE_STRING) && FEATURE(USE_CHAR)
+    {
+        char s1[10] = "", c1[4] = "", s2[10] = "", c2[4] = "";
+        int n1 = sscanf("  hello   world", "%s %3c", s1, c1);
+        int n2 = _sscnf("  hello   world", "%s %3c", s2, c2);
+        sprintf(stdbuf, "Scan %d [%s] [%s]\n", n1, s1, c1);
+        sprintf(testbuf, "Scan %d [%s] [%s]\n", n2, s2, c2);
+        testcompare();
+    }
+  #endif
+#endif
+
 // String-in-flash output, only relevant to AVR.
 #if FEATURE(USE_FSTRING) && defined(TEST_AVR)
     tprintf("FStr [%s] [%S] [%8S] [%-8S]\n", S, PSTR(S), PSTR(S), PSTR(S));
 #endif
+#if FEATURE(USE_FSTRING) && defined(COMPARE_TEST)
+    // On the PC the flash string is read in blocks from RAM.
+    texpect("FStr [Abc] [   Abcde] [Abcde   ] [Abcdefghijklm]\n", "FStr [%.3S] [%8S] [%-8S] [%S]\n", S, S, S, "Abcdefghijklm");
+#endif
 
     (void) argc;    // Suppress compiler warning about unused arguments.
     (void) argv;
@@ -0,0 +1,157 @@
+/*************************************************************************
+es-printf  -  configurable printf for embedded systems
+
+Synthetic trace generator for the replay benchmark. Writes a trace with
+a mix of formats and arguments typical of embedded logging and telemetry,
+so replay.sh can be run without a captured production trace.
+
+https://github.com/skirridsystems/es-printf
+
+**************************************************************************
+Copyright (c) 2006 - 2021 Skirrid Systems
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*************************************************************************/
+
+/* Trace format
+
+   One call per line, written as the arguments of a C call: the format as
+   a string literal followed by the arguments as C literals, with suffixes
+   giving their types, e.g.
+       "T=%d.%02u V=%u %s\n", 21, 5U, 3300U, "OK"
+   Lines starting with # and blank lines are ignored. A capture shim in the
+   product can write the same format, using U, L, UL, LL and ULL suffixes
+   and a decimal point in every double.
+
+   Usage: trace_gen [calls [seed]] > trace.txt
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static unsigned long seed = 1;
+
+// Simple generator so the trace is the same on every host.
+static unsigned long rnd(unsigned long n)
+{
+    seed = seed * 1103515245UL + 12345UL;
+    return ((seed >> 16) & 0x7fff) % n;
+}
+
+static long srnd(long n)
+{
+    return (long) rnd((unsigned long) (2 * n + 1)) - n;
+}
+
+static const char *const words[] = {
+    "OK", "FAIL", "idle", "rx", "tx", "boot", "sensor0", "link up", "timeout", "eeprom"
+};
+
+#define NWORDS  (sizeof(words) / sizeof(words[0]))
+
+/* ---------------------------------------------------------------------------
+Each template writes one record. The weights give the mix of calls, with
+short integer log lines most common and floating point the least.
+--------------------------------------------------------------------------- */
+static void t_log(void)
+{
+    printf("\"[%%5lu] %%s: %%d\\n\", %luUL, \"%s\", %ld\n",
+           rnd(30000) * 7UL, words[rnd(NWORDS)], srnd(1000));
+}
+
+static void t_temp(void)
+{
+    printf("\"T=%%d.%%02u V=%%u %%s\\n\", %ld, %luU, %luU, \"%s\"\n",
+           srnd(40), rnd(100), 3000 + rnd(600), words[rnd(2)]);
+}
+
+static void t_hex(void)
+{
+    printf("\"%%04x: %%02x %%02x %%02x %%02x\\n\", %luU, %luU, %luU, %luU, %luU\n",
+           rnd(0x10000), rnd(256), rnd(256), rnd(256), rnd(256));
+}
+
+static void t_reg(void)
+{
+    printf("\"REG %%-8s = 0x%%08lX\\n\", \"%s\", %lu%04luUL\n",
+           words[rnd(NWORDS)], 1 + rnd(65535), rnd(10000));
+}
+
+static void t_count(void)
+{
+    printf("\"%%s %%lld bytes\\n\", \"%s\", %s%lu%05luLL\n",
+           words[3 + rnd(2)], rnd(2) ? "-" : "", 1 + rnd(99999), rnd(100000));
+}
+
+static void t_text(void)
+{
+    printf("\"%%s\\n\", \"%s %s %s\"\n",
+           words[rnd(NWORDS)], words[rnd(NWORDS)], words[rnd(NWORDS)]);
+}
+
+static void t_char(void)
+{
+    printf("\"%%c%%c %%3d%%%%\\n\", '%c', '%c', %lu\n",
+           (int) ('A' + rnd(26)), (int) ('a' + rnd(26)), rnd(101));
+}
+
+static void t_float(void)
+{
+    printf("\"%%.3f %%e %%g\\n\", %ld.%03lu, %lu.%lue%ld, %ld.%lu\n",
+           srnd(1000), rnd(1000), 1 + rnd(9), rnd(1000), srnd(30), srnd(99999), rnd(100));
+}
+
+static const struct
+{
+    void (*write)(void);
+    unsigned weight;
+} templates[] = {
+    { t_log,    30 },
+    { t_temp,   20 },
+    { t_hex,    15 },
+    { t_reg,    10 },
+    { t_count,   5 },
+    { t_text,   10 },
+    { t_char,    5 },
+    { t_float,   5 },
+};
+
+#define NTEMPLATES  (sizeof(templates) / sizeof(templates[0]))
+
+int main(int argc, char *argv[])
+{
+    unsigned long calls = (argc > 1) ? strtoul(argv[1], 0, 10) : 1000;
+    unsigned long total = 0;
+    unsigned long pick;
+    unsigned i;
+
+    if (argc > 2) seed = strtoul(argv[2], 0, 10);
+    for (i = 0; i < NTEMPLATES; i++)
+        total += templates[i].weight;
+
+    printf("# Synthetic es-printf trace, %lu calls\n", calls);
+    while (calls--)
+    {
+        pick = rnd(total);
+        for (i = 0; pick >= templates[i].weight; i++)
+            pick -= templates[i].weight;
+        templates[i].write();
+    }
+    return 0;
+}
@@ -0,0 +1,550 @@
+/*************************************************************************
+es-printf  -  configurable printf for embedded systems
+
+printf_scan.c: Find the printf features used by a project.
+
+Scans C sources for printf format strings, or compiled files for any
+string containing a '%', and prints the smallest FEATURE_FLAGS set which
+supports every conversion found, along with a report of where each
+feature is used.
+
+https://github.com/skirridsystems/es-printf
+
+**************************************************************************
+Copyright (c) 2006 - 2021 Skirrid Systems
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*************************************************************************/
+
+/*
+Usage: printf_scan [options] files...
+
+  -f name     Also treat calls to name as printf calls. May be repeated.
+              printf, sprintf, _prntf and _sprntf are always included.
+  -c letters  Conversion letters registered with printf_register().
+  -b          Treat the files as binary, e.g. objects or images, and use
+              every printable string which contains a '%'.
+  -o file     Write the FEATURE_FLAGS definition to file instead of stdout.
+
+In a source file the format is the first string literal inside the call,
+joined with any literals which follow it, so wrappers such as PSTR() are
+handled. Macros inside format strings, such as PRIu32, are not expanded.
+Binary mode finds every format string, including those from libraries,
+but may also pick up other strings which happen to contain a '%'.
+
+The report goes to stderr. The exit status is 1 if any conversion is not
+supported by es-printf, so a build can stop before the firmware is made.
+
+The output can be passed to the compiler with -include, or included
+before printf_cfg.h, which only sets FEATURE_FLAGS if it is not defined.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_FUNCS   32
+#define MAX_TEXT    1024
+
+/*****************************************************************************
+Feature table
+******************************************************************************/
+
+enum
+{
+    F_FLOAT, F_LONG, F_OCTAL, F_SIGNED, F_SIGNED_I, F_UNSIGNED, F_HEX_LOWER,
+    F_HEX_UPPER, F_CHAR, F_STRING, F_FSTRING, F_BINARY, F_CUSTOM, F_TIMESTAMP,
+    F_HEX_FLOAT, F_PRECISION, F_ZERO_PAD, F_SPACE_PAD, F_INDIRECT, F_PLUS_SIGN,
+    F_SPACE_SIGN, F_LEFT_JUST, F_SPECIAL, F_LONG_LONG, F_ESCAPE, F_INT128, F_COUNT
+};
+
+// Names in the same order as the enum above.
+static const char *const feature_name[F_COUNT] = {
+    "USE_FLOAT", "USE_LONG", "USE_OCTAL", "USE_SIGNED", "USE_SIGNED_I", "USE_UNSIGNED", "USE_HEX_LOWER",
+    "USE_HEX_UPPER", "USE_CHAR", "USE_STRING", "USE_FSTRING", "USE_BINARY", "USE_CUSTOM", "USE_TIMESTAMP",
+    "USE_HEX_FLOAT", "USE_PRECISION", "USE_ZERO_PAD", "USE_SPACE_PAD", "USE_INDIRECT", "USE_PLUS_SIGN",
+    "USE_SPACE_SIGN", "USE_LEFT_JUST", "USE_SPECIAL", "USE_LONG_LONG", "USE_ESCAPE", "USE_INT128"
+};
+
+static struct
+{
+    unsigned long count;    // Number of uses
+    char where[80];         // Location of the first use
+} feature[F_COUNT];
+
+static const char *funcs[MAX_FUNCS] = { "printf", "sprintf", "_prntf", "_sprntf" };
+static int nfuncs = 4;
+static const char *custom = "";
+static unsigned long nformats;
+static unsigned long unsupported;
+
+/* ---------------------------------------------------------------------------
+Function: use()
+Record the use of a feature.
+--------------------------------------------------------------------------- */
+static void use(int f, const char *where)
+{
+    if (feature[f].count++ == 0)
+        snprintf(feature[f].where, sizeof(feature[f].where), "%s", where);
+}
+
+/* ---------------------------------------------------------------------------
+Function: scan_format()
+Find the features needed by one format string.
+--------------------------------------------------------------------------- */
+static void scan_format(const char *s, const char *where)
+{
+    const char *start;
+    int zero, left, width, prec;
+
+    ++nformats;
+    while ((s = strchr(s, '%')) != NULL)
+    {
+        start = s++;
+        zero = left = width = prec = 0;
+
+        // Flags
+        for (;; s++)
+        {
+            if      (*s == '0') { zero = 1; use(F_ZERO_PAD, where); }
+            else if (*s == '-') { left = 1; use(F_LEFT_JUST, where); }
+            else if (*s == '+') use(F_PLUS_SIGN, where);
+            else if (*s == ' ') use(F_SPACE_SIGN, where);
+            else if (*s == '#') use(F_SPECIAL, where);
+            else break;
+        }
+        // Width
+        if (*s == '*')
+        {
+            width = 1;
+            use(F_INDIRECT, where);
+            ++s;
+        }
+        for (; *s >= '0' && *s <= '9'; s++)
+            width = 1;
+        // Precision
+        if (*s == '.')
+        {
+            prec = 1;
+            if (*++s == '*')
+            {
+                use(F_INDIRECT, where);
+                ++s;
+            }
+            while (*s >= '0' && *s <= '9')
+                ++s;
+        }
+        // Length
+        if (*s == 'l')
+        {
+            use(F_LONG, where);
+            if (*++s == 'l')
+            {
+                use(F_LONG_LONG, where);
+                ++s;
+            }
+        }
+        else if (*s == 'w' && strncmp(s, "w128", 4) == 0 && (s[4] < '0' || s[4] > '9'))
+        {
+            use(F_LONG, where);
+            use(F_LONG_LONG, where);
+            use(F_INT128, where);
+            s += 4;
+        }
+        else if (*s == 'w' && strncmp(s, "w64", 3) == 0 && (s[3] < '0' || s[3] > '9'))
+        {
+            use(F_LONG, where);
+            use(F_LONG_LONG, where);
+            use(F_INT128, where);
+            s += 3;
+        }
+        else if (*s == 'w' && strncmp(s, "w32", 3) == 0 && (s[3] < '0' || s[3] > '9'))
+        {
+            // Long is needed where int has only 16 bits.
+            use(F_LONG, where);
+            use(F_INT128, where);
+            s += 3;
+        }
+        else if (*s && strchr("hjztLqw", *s))
+        {
+            fprintf(stderr, "%s: unsupported length in %.*s\n", where, (int) (s - start + 2), start);
+            ++unsupported;
+            continue;
+        }
+        if (*s == '\0')
+        {
+            fprintf(stderr, "%s: incomplete conversion %s\n", where, start);
+            ++unsupported;
+            break;
+        }
+
+        // Conversion
+        switch (*s)
+        {
+        case '%':                                   break;
+        case 'd': use(F_SIGNED, where);             break;
+        case 'i': use(F_SIGNED_I, where);           break;
+        case 'u': use(F_UNSIGNED, where);           break;
+        case 'o': use(F_OCTAL, where);              break;
+        case 'b': use(F_BINARY, where);             break;
+        case 'x': use(F_HEX_LOWER, where);          break;
+        case 'X': use(F_HEX_UPPER, where);          break;
+        case 'c': use(F_CHAR, where);               break;
+        case 'S': use(F_FSTRING, where);            // fall through
+        case 's': use(F_STRING, where);             break;
+        case 'T': use(F_TIMESTAMP, where);          break;
+        case 'a': case 'A': use(F_HEX_FLOAT, where); break;
+        case 'J': case 'Q': use(F_ESCAPE, where);    break;
+        case 'f': case 'e': case 'E': case 'g': case 'G':
+            use(F_FLOAT, where);
+            break;
+        default:
+            if (strchr(custom, *s))
+            {
+                use(F_CUSTOM, where);
+            }
+            else
+            {
+                fprintf(stderr, "%s: unsupported conversion %.*s\n", where, (int) (s - start + 1), start);
+                ++unsupported;
+            }
+            break;
+        }
+        // Padding to a width is done with spaces unless zero padding applies.
+        if (width)
+        {
+            if (!zero || left || strchr("csST", *s) || strchr(custom, *s))
+                use(F_SPACE_PAD, where);
+        }
+        if (prec)
+            use(F_PRECISION, where);
+        ++s;
+    }
+}
+
+/*****************************************************************************
+Source scanning
+******************************************************************************/
+
+/* ---------------------------------------------------------------------------
+Function: read_literal()
+Decode the string literal starting after the opening quote at p, appending
+it to text. Returns a pointer after the closing quote.
+--------------------------------------------------------------------------- */
+static const char *read_literal(const char *p, char *text, size_t *len, unsigned *line)
+{
+    char c;
+
+    while (*p && *p != '"')
+    {
+        c = *p++;
+        if (c == '\n')
+            ++*line;
+        if (c == '\\' && *p)
+        {
+            c = *p++;
+            switch (c)
+            {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'r': c = '\r'; break;
+            case '0': case '1': case '2': case '3':
+                c = (char) strtol(p - 1, (char **) &p, 8);
+                break;
+            case 'x':
+                c = (char) strtol(p, (char **) &p, 16);
+                break;
+            case '\n':
+                ++*line;
+                continue;
+            default:
+                break;
+            }
+        }
+        if (*len < MAX_TEXT - 1)
+            text[(*len)++] = c;
+    }
+    text[*len] = '\0';
+    return *p ? p + 1 : p;
+}
+
+/* ---------------------------------------------------------------------------
+Function: is_func()
+Check whether the identifier of the given length is a printf function.
+--------------------------------------------------------------------------- */
+static int is_func(const char *id, size_t n)
+{
+    int i;
+
+    for (i = 0; i < nfuncs; i++)
+    {
+        if (strlen(funcs[i]) == n && memcmp(funcs[i], id, n) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/* ---------------------------------------------------------------------------
+Function: scan_source()
+Find the format strings in the calls to printf functions in a C source.
+Comments and character constants are skipped. Inside a call, the first
+string literal and any literals following it make up the format.
+--------------------------------------------------------------------------- */
+static void scan_source(const char *name, const char *p)
+{
+    unsigned line = 1, fline = 0;
+    int depth = 0;          // Bracket depth inside a printf call, 0 if none
+    int pending = 0;        // A printf function name has been seen
+    int found = 0;          // The format for this call has been read
+    size_t len = 0;
+    const char *id;
+    char text[MAX_TEXT];
+    char where[80];
+
+    while (*p)
+    {
+        if (p[0] == '/' && p[1] == '*')
+        {
+            for (p += 2; *p && !(p[0] == '*' && p[1] == '/'); p++)
+                if (*p == '\n') ++line;
+            if (*p) p += 2;
+        }
+        else if (p[0] == '/' && p[1] == '/')
+        {
+            while (*p && *p != '\n') ++p;
+        }
+        else if (*p == '\'')
+        {
+            for (++p; *p && *p != '\''; p++)
+                if (*p == '\\' && p[1]) ++p;
+            if (*p) ++p;
+        }
+        else if (*p == '"')
+        {
+            if (depth > 0 && !found)
+            {
+                if (len == 0) fline = line;
+                p = read_literal(p + 1, text, &len, &line);
+                continue;
+            }
+            len = 0;
+            p = read_literal(p + 1, text, &len, &line);
+            len = 0;
+            continue;
+        }
+        else if (*p == '_' || (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z'))
+        {
+            for (id = p; *p == '_' || (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+                         (*p >= '0' && *p <= '9'); p++)
+                ;
+            if (depth == 0)
+                pending = is_func(id, (size_t) (p - id));
+            continue;
+        }
+        else if (*p == '(')
+        {
+            if (depth > 0)
+                ++depth;
+            else if (pending)
+            {
+                depth = 1;
+                found = 0;
+                len = 0;
+            }
+        }
+        else if (*p == ')' && depth > 0)
+        {
+            --depth;
+        }
+        else if (*p == '\n')
+        {
+            ++line;
+        }
+
+        // Anything but white space ends the run of literals making the format.
+        if (len && !found && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
+        {
+            snprintf(where, sizeof(where), "%s:%u", name, fline);
+            scan_format(text, where);
+            found = 1;
+            len = 0;
+        }
+        if (*p != ' ' && *p != '\t' && *p != '\n' && *p != '\r' && *p != '(')
+            pending = 0;
+        ++p;
+    }
+}
+
+/*****************************************************************************
+Binary scanning
+******************************************************************************/
+
+/* ---------------------------------------------------------------------------
+Function: scan_binary()
+Find every run of printable characters containing a '%'. Strings in a
+compiled file are null terminated, so a run ends at any other byte.
+--------------------------------------------------------------------------- */
+static void scan_binary(const char *name, const unsigned char *p, size_t size)
+{
+    size_t i, start = 0;
+    char text[MAX_TEXT];
+    char where[80];
+    size_t len;
+
+    for (i = 0; i <= size; i++)
+    {
+        if (i < size && ((p[i] >= ' ' && p[i] < 0x7f) || p[i] == '\n' || p[i] == '\t' || p[i] == '\r'))
+            continue;
+        len = i - start;
+        if (len >= 2 && memchr(p + start, '%', len))
+        {
+            if (len > MAX_TEXT - 1) len = MAX_TEXT - 1;
+            memcpy(text, p + start, len);
+            text[len] = '\0';
+            snprintf(where, sizeof(where), "%s:0x%lx", name, (unsigned long) start);
+            scan_format(text, where);
+        }
+        start = i + 1;
+    }
+}
+
+/* ---------------------------------------------------------------------------
+Function: read_file()
+Read a whole file into memory with a null terminator added.
+--------------------------------------------------------------------------- */
+static char *read_file(const char *name, size_t *size)
+{
+    FILE *f = fopen(name, "rb");
+    char *buf = NULL;
+    long n;
+
+    if (f == NULL)
+        return NULL;
+    if (fseek(f, 0, SEEK_END) == 0 && (n = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0)
+    {
+        buf = malloc((size_t) n + 1);
+        if (buf && fread(buf, 1, (size_t) n, f) == (size_t) n)
+        {
+            buf[n] = '\0';
+            *size = (size_t) n;
+        }
+        else
+        {
+            free(buf);
+            buf = NULL;
+        }
+    }
+    fclose(f);
+    return buf;
+}
+
+/*****************************************************************************
+Output
+******************************************************************************/
+
+/* ---------------------------------------------------------------------------
+Function: write_flags()
+Write the FEATURE_FLAGS definition for the features used.
+--------------------------------------------------------------------------- */
+static void write_flags(FILE *out, int nfiles)
+{
+    int f;
+
+    fprintf(out, "// Generated by printf_scan from %lu format strings in %d file%s.\n",
+            nformats, nfiles, nfiles == 1 ? "" : "s");
+    fprintf(out, "#define FEATURE_FLAGS ( 0 \\\n");
+    for (f = 0; f < F_COUNT; f++)
+    {
+        if (feature[f].count)
+            fprintf(out, "        | %-15s \\\n", feature_name[f]);
+    }
+    fprintf(out, ")\n");
+}
+
+/* ---------------------------------------------------------------------------
+Function: write_report()
+Report how many times each feature is used and where it is first used.
+--------------------------------------------------------------------------- */
+static void write_report(void)
+{
+    int f;
+
+    fprintf(stderr, "%-16s %6s  %s\n", "Feature", "Uses", "First use");
+    for (f = 0; f < F_COUNT; f++)
+    {
+        if (feature[f].count)
+            fprintf(stderr, "%-16s %6lu  %s\n", feature_name[f], feature[f].count, feature[f].where);
+    }
+    if (unsupported)
+        fprintf(stderr, "%lu unsupported conversions\n", unsupported);
+}
+
+int main(int argc, char *argv[])
+{
+    int i, binary = 0, nfiles = 0;
+    const char *outname = NULL;
+    FILE *out = stdout;
+    char *buf;
+    size_t size = 0;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (strcmp(argv[i], "-b") == 0)
+            binary = 1;
+        else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc && nfuncs < MAX_FUNCS)
+            funcs[nfuncs++] = argv[++i];
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            custom = argv[++i];
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            outname = argv[++i];
+        else
+            break;
+    }
+    if (i >= argc)
+    {
+        fprintf(stderr, "Usage: printf_scan [-f func]... [-c letters] [-b] [-o file] files...\n");
+        return 2;
+    }
+
+    for (; i < argc; i++, nfiles++)
+    {
+        buf = read_file(argv[i], &size);
+        if (buf == NULL)
+        {
+            fprintf(stderr, "printf_scan: cannot read %s\n", argv[i]);
+            return 2;
+        }
+        if (binary)
+            scan_binary(argv[i], (const unsigned char *) buf, size);
+        else
+            scan_source(argv[i], buf);
+        free(buf);
+    }
+
+    if (outname && (out = fopen(outname, "w")) == NULL)
+    {
+        fprintf(stderr, "printf_scan: cannot write %s\n", outname);
+        return 2;
+    }
+    write_flags(out, nfiles);
+    if (out != stdout)
+        fclose(out);
+    write_report();
+    return unsupported ? 1 : 0;
+}